@@ -0,0 +1,620 @@
+/**
+ * Copyright (C) 2021 Jessica James.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Written by Jessica James <jessica.aj@outlook.com>
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#if defined _WIN32
+#include <WinSock2.h>
+#else // _WIN32
+#include <poll.h>
+#endif // _WIN32
+
+#if defined __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#define JUPITER_EVENTLOOP_EPOLL
+#endif // __linux__
+
+#include "EventLoop.h"
+#include "Socket.h"
+#include "Thinker.h"
+#include "Timer.h"
+
+constexpr size_t s_max_events = 64; // Events handled per epoll_wait() call
+constexpr std::chrono::milliseconds s_fallback_poll_interval{ 10 }; // Longest wait without epoll, since nothing can interrupt poll()
+
+using clock_type = std::chrono::steady_clock;
+
+struct Jupiter::EventLoop::Data {
+	/** Descriptor being waited on */
+	struct Watch {
+		int descriptor = -1;
+		uint32_t events = 0;
+		Callback callback; // Cleared when removed, so that events already returned for it are skipped
+	};
+
+	struct ThinkerEntry {
+		Thinker *thinker;
+		std::chrono::milliseconds interval;
+		clock_type::time_point next_think;
+		ThinkerCallback on_finished;
+		Watch watch; // Thinker's descriptor, if any; one-shot, and re-armed after each think()
+		bool active = true;
+	};
+
+	struct TimerEntry {
+		Task task;
+		std::chrono::milliseconds delay;
+		bool repeat;
+	};
+
+	std::unordered_map<int, std::unique_ptr<Watch>> watches;
+	std::vector<std::unique_ptr<Watch>> retired_watches; // Freed at the end of runOnce(), once no events can reference them
+	std::list<ThinkerEntry> thinkers;
+	std::map<std::pair<clock_type::time_point, TimerID>, TimerEntry> timers;
+	std::unordered_map<TimerID, clock_type::time_point> timer_deadlines;
+	TimerID next_timer_id = 0;
+	bool run_timers = false;
+	std::atomic<bool> stopping{ false };
+	std::mutex tasks_mutex;
+	std::vector<Task> tasks;
+#if defined JUPITER_EVENTLOOP_EPOLL
+	int epoll_fd = -1; // -1 when epoll is unavailable; runOnce() falls back to poll()
+	int wake_fd = -1; // eventfd used to interrupt epoll_wait()
+	int timer_fd = -1; // timerfd armed for the next deadline
+	Watch wake_watch; // Identifies wake_fd's events
+	Watch timer_watch; // Identifies timer_fd's events
+	clock_type::time_point armed_deadline = clock_type::time_point::max();
+	std::vector<epoll_event> events = std::vector<epoll_event>(s_max_events);
+#endif // JUPITER_EVENTLOOP_EPOLL
+
+	void retire(std::unique_ptr<Watch> in_watch);
+	bool is_registered(int in_descriptor, const ThinkerEntry &in_except) const;
+	void arm_thinker(ThinkerEntry &in_entry);
+	void remove_thinker(ThinkerEntry &in_entry);
+	void think(ThinkerEntry &in_entry);
+	clock_type::time_point next_deadline() const;
+	size_t run_due(clock_type::time_point in_now);
+	size_t run_tasks();
+	size_t poll_watches(int in_timeout_ms);
+#if defined JUPITER_EVENTLOOP_EPOLL
+	size_t poll_events(clock_type::time_point in_deadline, int in_timeout_ms);
+#endif // JUPITER_EVENTLOOP_EPOLL
+};
+
+#if defined JUPITER_EVENTLOOP_EPOLL
+static uint32_t to_epoll_events(uint32_t in_events) {
+	uint32_t result = 0;
+	if ((in_events & Jupiter::EventLoop::READ) != 0) {
+		result |= EPOLLIN;
+	}
+	if ((in_events & Jupiter::EventLoop::WRITE) != 0) {
+		result |= EPOLLOUT;
+	}
+	return result;
+}
+
+static uint32_t from_epoll_events(uint32_t in_events) {
+	uint32_t result = 0;
+	if ((in_events & EPOLLIN) != 0) {
+		result |= Jupiter::EventLoop::READ;
+	}
+	if ((in_events & EPOLLOUT) != 0) {
+		result |= Jupiter::EventLoop::WRITE;
+	}
+	if ((in_events & (EPOLLERR | EPOLLHUP)) != 0) {
+		result |= Jupiter::EventLoop::CLOSED;
+	}
+	return result;
+}
+#endif // JUPITER_EVENTLOOP_EPOLL
+
+static int poll_descriptors(pollfd *in_descriptors, size_t in_count, int in_timeout) {
+#if defined _WIN32
+	return WSAPoll(in_descriptors, static_cast<ULONG>(in_count), in_timeout);
+#else // _WIN32
+	return ::poll(in_descriptors, in_count, in_timeout);
+#endif // _WIN32
+}
+
+// Data functions
+
+void Jupiter::EventLoop::Data::retire(std::unique_ptr<Watch> in_watch) {
+#if defined JUPITER_EVENTLOOP_EPOLL
+	if (epoll_fd >= 0) {
+		epoll_ctl(epoll_fd, EPOLL_CTL_DEL, in_watch->descriptor, nullptr);
+	}
+#endif // JUPITER_EVENTLOOP_EPOLL
+
+	in_watch->callback = nullptr;
+	retired_watches.push_back(std::move(in_watch));
+}
+
+// Whether a watch, or a thinker other than in_except, is registered on in_descriptor
+bool Jupiter::EventLoop::Data::is_registered(int in_descriptor, const ThinkerEntry &in_except) const {
+	if (watches.find(in_descriptor) != watches.end()) {
+		return true;
+	}
+
+	return std::any_of(thinkers.begin(), thinkers.end(), [in_descriptor, &in_except](const ThinkerEntry &in_entry) {
+		return &in_entry != &in_except && in_entry.active && in_entry.watch.descriptor == in_descriptor;
+	});
+}
+
+void Jupiter::EventLoop::Data::arm_thinker(ThinkerEntry &in_entry) {
+	int descriptor = in_entry.thinker->getDescriptor();
+#if defined JUPITER_EVENTLOOP_EPOLL
+	if (epoll_fd >= 0) {
+		// The old descriptor may already be closed, in which case epoll dropped it; don't disturb a watch or another
+		// thinker reusing its number
+		if (descriptor != in_entry.watch.descriptor && in_entry.watch.descriptor >= 0
+			&& !is_registered(in_entry.watch.descriptor, in_entry)) {
+			epoll_ctl(epoll_fd, EPOLL_CTL_DEL, in_entry.watch.descriptor, nullptr);
+		}
+
+		if (descriptor >= 0) {
+			// Descriptors are re-armed with MOD, falling back to ADD for new ones and for reused numbers which epoll dropped
+			epoll_event event{};
+			event.events = EPOLLIN | EPOLLONESHOT;
+			event.data.ptr = &in_entry.watch;
+			if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, descriptor, &event) != 0 && errno == ENOENT) {
+				epoll_ctl(epoll_fd, EPOLL_CTL_ADD, descriptor, &event);
+			}
+		}
+	}
+#endif // JUPITER_EVENTLOOP_EPOLL
+
+	in_entry.watch.descriptor = descriptor;
+}
+
+void Jupiter::EventLoop::Data::remove_thinker(ThinkerEntry &in_entry) {
+#if defined JUPITER_EVENTLOOP_EPOLL
+	if (epoll_fd >= 0 && in_entry.watch.descriptor >= 0 && !is_registered(in_entry.watch.descriptor, in_entry)) {
+		epoll_ctl(epoll_fd, EPOLL_CTL_DEL, in_entry.watch.descriptor, nullptr);
+	}
+#endif // JUPITER_EVENTLOOP_EPOLL
+
+	// Erased at the end of runOnce(), since events may still reference it
+	in_entry.active = false;
+	in_entry.watch.callback = nullptr;
+}
+
+void Jupiter::EventLoop::Data::think(ThinkerEntry &in_entry) {
+	int result = in_entry.thinker->think();
+	if (result != 0) {
+		remove_thinker(in_entry);
+		if (in_entry.on_finished) {
+			in_entry.on_finished(result);
+		}
+		return;
+	}
+
+	in_entry.next_think = clock_type::now() + in_entry.interval;
+	arm_thinker(in_entry);
+}
+
+clock_type::time_point Jupiter::EventLoop::Data::next_deadline() const {
+	clock_type::time_point result = clock_type::time_point::max();
+	if (!timers.empty()) {
+		result = timers.begin()->first.first;
+	}
+
+	for (const ThinkerEntry &entry : thinkers) {
+		if (entry.active) {
+			result = std::min(result, entry.next_think);
+		}
+	}
+
+	if (run_timers) {
+		result = std::min(result, Jupiter::Timer::next());
+	}
+
+	return result;
+}
+
+size_t Jupiter::EventLoop::Data::run_due(clock_type::time_point in_now) {
+	size_t result = 0;
+
+	// Timers are taken out of the map before running, since tasks may add or cancel timers
+	while (!timers.empty() && timers.begin()->first.first <= in_now) {
+		auto node = timers.extract(timers.begin());
+		TimerID id = node.key().second;
+		if (node.mapped().repeat) {
+			Task task = node.mapped().task;
+			node.key().first = in_now + node.mapped().delay;
+			timer_deadlines[id] = node.key().first;
+			timers.insert(std::move(node));
+			task();
+		}
+		else {
+			timer_deadlines.erase(id);
+			node.mapped().task();
+		}
+		++result;
+	}
+
+	for (ThinkerEntry &entry : thinkers) {
+		if (entry.active && entry.next_think <= in_now) {
+			think(entry);
+			++result;
+		}
+	}
+
+	if (run_timers && Jupiter::Timer::next() <= in_now) {
+		Jupiter::Timer::check();
+		++result;
+	}
+
+	return result;
+}
+
+size_t Jupiter::EventLoop::Data::run_tasks() {
+	std::vector<Task> pending;
+	{
+		std::lock_guard<std::mutex> guard{ tasks_mutex };
+		pending.swap(tasks);
+	}
+
+	for (Task &task : pending) {
+		task();
+	}
+
+	return pending.size();
+}
+
+size_t Jupiter::EventLoop::Data::poll_watches(int in_timeout_ms) {
+	std::vector<pollfd> descriptors;
+	std::vector<Watch *> descriptor_watches;
+	for (auto &watch : watches) {
+		short events = 0;
+		if ((watch.second->events & READ) != 0) {
+			events |= POLLIN;
+		}
+		if ((watch.second->events & WRITE) != 0) {
+			events |= POLLOUT;
+		}
+		descriptors.push_back({ static_cast<Socket::SocketType>(watch.first), events, 0 });
+		descriptor_watches.push_back(watch.second.get());
+	}
+
+	for (ThinkerEntry &entry : thinkers) {
+		if (entry.active && entry.watch.descriptor >= 0) {
+			descriptors.push_back({ static_cast<Socket::SocketType>(entry.watch.descriptor), POLLIN, 0 });
+			descriptor_watches.push_back(&entry.watch);
+		}
+	}
+
+	if (descriptors.empty()) {
+		// Nothing to poll; WSAPoll() rejects an empty set, so just sleep
+		if (in_timeout_ms > 0) {
+			std::this_thread::sleep_for(std::chrono::milliseconds{ in_timeout_ms });
+		}
+		return 0;
+	}
+
+	size_t result = 0;
+	if (poll_descriptors(descriptors.data(), descriptors.size(), in_timeout_ms) > 0) {
+		for (size_t index = 0; index != descriptors.size(); ++index) {
+			short revents = descriptors[index].revents;
+			Watch *watch = descriptor_watches[index];
+			if (revents == 0 || !watch->callback) {
+				continue;
+			}
+
+			uint32_t events = 0;
+			if ((revents & POLLIN) != 0) {
+				events |= READ;
+			}
+			if ((revents & POLLOUT) != 0) {
+				events |= WRITE;
+			}
+			if ((revents & (POLLERR | POLLHUP | POLLNVAL)) != 0) {
+				events |= CLOSED;
+			}
+
+			watch->callback(events);
+			++result;
+		}
+	}
+
+	return result;
+}
+
+#if defined JUPITER_EVENTLOOP_EPOLL
+size_t Jupiter::EventLoop::Data::poll_events(clock_type::time_point in_deadline, int in_timeout_ms) {
+	if (in_deadline != armed_deadline && in_timeout_ms != 0) {
+		// A zeroed itimerspec disarms the timer
+		itimerspec spec{};
+		if (in_deadline != clock_type::time_point::max()) {
+			auto since_epoch = in_deadline.time_since_epoch();
+			auto seconds = std::chrono::duration_cast<std::chrono::seconds>(since_epoch);
+			spec.it_value.tv_sec = static_cast<time_t>(seconds.count());
+			spec.it_value.tv_nsec = static_cast<long>(std::chrono::duration_cast<std::chrono::nanoseconds>(since_epoch - seconds).count());
+			if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) {
+				spec.it_value.tv_nsec = 1;
+			}
+		}
+
+		// steady_clock is CLOCK_MONOTONIC, which the timer was created with
+		timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, nullptr);
+		armed_deadline = in_deadline;
+	}
+
+	size_t result = 0;
+	int event_count = epoll_wait(epoll_fd, events.data(), static_cast<int>(events.size()), in_timeout_ms);
+	for (int index = 0; index < event_count; ++index) {
+		const epoll_event &event = events[index];
+		if (event.data.ptr == &wake_watch) {
+			eventfd_t counter;
+			eventfd_read(wake_fd, &counter);
+			continue;
+		}
+
+		if (event.data.ptr == &timer_watch) {
+			uint64_t expirations;
+			if (::read(timer_fd, &expirations, sizeof(expirations)) > 0) {
+				armed_deadline = clock_type::time_point::max();
+			}
+			continue;
+		}
+
+		Watch *watch = static_cast<Watch *>(event.data.ptr);
+		if (watch->callback) {
+			watch->callback(from_epoll_events(event.events));
+			++result;
+		}
+	}
+
+	return result;
+}
+#endif // JUPITER_EVENTLOOP_EPOLL
+
+// EventLoop functions
+
+Jupiter::EventLoop::EventLoop() {
+	m_data = new Data();
+#if defined JUPITER_EVENTLOOP_EPOLL
+	m_data->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	m_data->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	m_data->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (m_data->epoll_fd < 0 || m_data->wake_fd < 0 || m_data->timer_fd < 0) {
+		if (m_data->epoll_fd >= 0) {
+			::close(m_data->epoll_fd);
+			m_data->epoll_fd = -1;
+		}
+		return;
+	}
+
+	epoll_event event{};
+	event.events = EPOLLIN;
+	event.data.ptr = &m_data->wake_watch;
+	epoll_ctl(m_data->epoll_fd, EPOLL_CTL_ADD, m_data->wake_fd, &event);
+	event.data.ptr = &m_data->timer_watch;
+	epoll_ctl(m_data->epoll_fd, EPOLL_CTL_ADD, m_data->timer_fd, &event);
+#endif // JUPITER_EVENTLOOP_EPOLL
+}
+
+Jupiter::EventLoop::~EventLoop() {
+#if defined JUPITER_EVENTLOOP_EPOLL
+	for (int descriptor : { m_data->timer_fd, m_data->wake_fd, m_data->epoll_fd }) {
+		if (descriptor >= 0) {
+			::close(descriptor);
+		}
+	}
+#endif // JUPITER_EVENTLOOP_EPOLL
+
+	delete m_data;
+}
+
+bool Jupiter::EventLoop::watch(int in_descriptor, uint32_t in_events, Callback in_callback) {
+	if (in_descriptor < 0) {
+		return false;
+	}
+
+	// A new Watch replaces any existing one, since the existing callback may be the one running
+	auto watch = std::make_unique<Data::Watch>();
+	watch->descriptor = in_descriptor;
+	watch->events = in_events;
+	watch->callback = std::move(in_callback);
+
+	auto itr = m_data->watches.find(in_descriptor);
+#if defined JUPITER_EVENTLOOP_EPOLL
+	if (m_data->epoll_fd >= 0) {
+		epoll_event event{};
+		event.events = to_epoll_events(in_events);
+		event.data.ptr = watch.get();
+		if (epoll_ctl(m_data->epoll_fd, itr == m_data->watches.end() ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, in_descriptor, &event) != 0) {
+			return false;
+		}
+	}
+#endif // JUPITER_EVENTLOOP_EPOLL
+
+	if (itr != m_data->watches.end()) {
+		itr->second->callback = nullptr;
+		m_data->retired_watches.push_back(std::move(itr->second));
+		itr->second = std::move(watch);
+	}
+	else {
+		m_data->watches.emplace(in_descriptor, std::move(watch));
+	}
+
+	return true;
+}
+
+bool Jupiter::EventLoop::watch(Socket &in_socket, uint32_t in_events, Callback in_callback) {
+	return watch(static_cast<int>(in_socket.getDescriptor()), in_events, std::move(in_callback));
+}
+
+bool Jupiter::EventLoop::unwatch(int in_descriptor) {
+	auto itr = m_data->watches.find(in_descriptor);
+	if (itr == m_data->watches.end()) {
+		return false;
+	}
+
+	std::unique_ptr<Data::Watch> watch = std::move(itr->second);
+	m_data->watches.erase(itr);
+	m_data->retire(std::move(watch));
+	return true;
+}
+
+bool Jupiter::EventLoop::unwatch(Socket &in_socket) {
+	return unwatch(static_cast<int>(in_socket.getDescriptor()));
+}
+
+Jupiter::EventLoop::TimerID Jupiter::EventLoop::addTimer(std::chrono::milliseconds in_delay, Task in_task, bool in_repeat) {
+	TimerID id = ++m_data->next_timer_id;
+	clock_type::time_point deadline = clock_type::now() + in_delay;
+	m_data->timers.emplace(std::make_pair(deadline, id), Data::TimerEntry{ std::move(in_task), in_delay, in_repeat });
+	m_data->timer_deadlines.emplace(id, deadline);
+	return id;
+}
+
+bool Jupiter::EventLoop::cancelTimer(TimerID in_timer) {
+	auto itr = m_data->timer_deadlines.find(in_timer);
+	if (itr == m_data->timer_deadlines.end()) {
+		return false;
+	}
+
+	m_data->timers.erase(std::make_pair(itr->second, in_timer));
+	m_data->timer_deadlines.erase(itr);
+	return true;
+}
+
+void Jupiter::EventLoop::addThinker(Thinker &in_thinker, std::chrono::milliseconds in_interval, ThinkerCallback in_on_finished) {
+	Data::ThinkerEntry &entry = m_data->thinkers.emplace_back();
+	entry.thinker = &in_thinker;
+	entry.interval = in_interval;
+	entry.next_think = clock_type::now();
+	entry.on_finished = std::move(in_on_finished);
+	entry.watch.events = READ;
+	entry.watch.callback = [this, &entry](uint32_t) {
+		m_data->think(entry);
+	};
+	m_data->arm_thinker(entry);
+}
+
+bool Jupiter::EventLoop::removeThinker(Thinker &in_thinker) {
+	for (Data::ThinkerEntry &entry : m_data->thinkers) {
+		if (entry.active && entry.thinker == &in_thinker) {
+			m_data->remove_thinker(entry);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void Jupiter::EventLoop::setRunTimers(bool in_run_timers) {
+	m_data->run_timers = in_run_timers;
+}
+
+bool Jupiter::EventLoop::getRunTimers() const {
+	return m_data->run_timers;
+}
+
+void Jupiter::EventLoop::post(Task in_task) {
+	{
+		std::lock_guard<std::mutex> guard{ m_data->tasks_mutex };
+		m_data->tasks.push_back(std::move(in_task));
+	}
+	wake();
+}
+
+void Jupiter::EventLoop::wake() {
+#if defined JUPITER_EVENTLOOP_EPOLL
+	if (m_data->wake_fd >= 0) {
+		eventfd_write(m_data->wake_fd, 1);
+	}
+#endif // JUPITER_EVENTLOOP_EPOLL
+}
+
+void Jupiter::EventLoop::stop() {
+	m_data->stopping = true;
+	wake();
+}
+
+size_t Jupiter::EventLoop::runOnce(std::chrono::milliseconds in_timeout) {
+	size_t result = m_data->run_tasks();
+
+	auto now = clock_type::now();
+	auto deadline = m_data->next_deadline();
+	int timeout_ms = -1;
+	if (in_timeout.count() >= 0) {
+		timeout_ms = static_cast<int>(std::min<std::chrono::milliseconds::rep>(in_timeout.count(), INT_MAX));
+	}
+	if (result != 0 || deadline <= now) {
+		timeout_ms = 0;
+	}
+
+#if defined JUPITER_EVENTLOOP_EPOLL
+	if (m_data->epoll_fd >= 0) {
+		result += m_data->poll_events(deadline, timeout_ms);
+	}
+	else
+#endif // JUPITER_EVENTLOOP_EPOLL
+	{
+		// Nothing interrupts poll(), so wake up periodically to pick up deadlines and posted tasks
+		int fallback_timeout = static_cast<int>(s_fallback_poll_interval.count());
+		if (deadline != clock_type::time_point::max()) {
+			auto until_deadline = std::chrono::ceil<std::chrono::milliseconds>(deadline - now).count();
+			fallback_timeout = static_cast<int>(std::clamp<std::chrono::milliseconds::rep>(until_deadline, 0, fallback_timeout));
+		}
+		if (timeout_ms >= 0) {
+			fallback_timeout = std::min(fallback_timeout, timeout_ms);
+		}
+		result += m_data->poll_watches(fallback_timeout);
+	}
+
+	result += m_data->run_due(clock_type::now());
+	result += m_data->run_tasks();
+
+	m_data->retired_watches.clear();
+	m_data->thinkers.remove_if([](const Data::ThinkerEntry &in_entry) {
+		return !in_entry.active;
+	});
+
+	return result;
+}
+
+void Jupiter::EventLoop::run() {
+	while (!m_data->stopping) {
+		runOnce();
+	}
+
+	m_data->stopping = false;
+}
+
+int Jupiter::EventLoop::getDescriptor() const {
+#if defined JUPITER_EVENTLOOP_EPOLL
+	return m_data->epoll_fd;
+#else // JUPITER_EVENTLOOP_EPOLL
+	return -1;
+#endif // JUPITER_EVENTLOOP_EPOLL
+}
@@ -16,35 +16,47 @@
  * Written by Jessica James <jessica.aj@outlook.com>
  */
 
+#include <algorithm>
+#include <charconv>
 #include <ctime>
 #include <chrono>
-#include <numeric>
-#include "jessilib/split.hpp"
+#include <condition_variable>
+#include <deque>
+#include <limits>
+#include <list>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <sys/stat.h>
+#include <fcntl.h>
 #include "jessilib/unicode.hpp"
 #include "TCPSocket.h"
 #include "HTTP.h"
 #include "HTTP_Server.h"
+#include "Config.h" // JUPITER_WRAP_MAP_KEY
 
-using namespace std::literals;
+#if defined __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#define JUPITER_HTTP_EPOLL
+#endif // __linux__
 
-static const std::string_view HTTP_REQUEST_ENDING = "\r\n\r\n"sv;
-#define HTTP_ENDL "\r\n"
+#if defined _WIN32
+#include <io.h>
+#else // _WIN32
+#include <unistd.h>
+#endif // _WIN32
 
-template<typename ResultT = unsigned int, typename InT>
-ResultT calc_checksum(const InT& in_container) {
-	ResultT result{};
-	result = std::accumulate(in_container.begin(), in_container.end(), result);
-	return result;
-}
+using namespace std::literals;
 
-template<typename ResultT = unsigned int, typename InT>
-ResultT calc_checksumi(const InT& in_container) {
-	ResultT result{};
-	result = std::accumulate(in_container.begin(), in_container.end(), result, [](ResultT current_sum, typename InT::value_type current_element) {
-		return current_sum + jessilib::fold(current_element);
-	});
-	return result;
-}
+#define HTTP_ENDL "\r\n"
+#define HTTP_SERVER_HEADER "Server: " JUPITER_VERSION HTTP_ENDL
 
 // HTTPCommand
 
@@ -65,763 +77,2908 @@ enum HTTPVersion
 	HTTP_Unsupported
 };
 
-// HTTP::Server::Content
-
-Jupiter::HTTP::Server::Content::Content(std::string in_name, Jupiter::HTTP::Server::HTTPFunction in_function)
-	: name(std::move(in_name)) {
-	Jupiter::HTTP::Server::Content::function = in_function;
-	Jupiter::HTTP::Server::Content::name_checksum = calc_checksum(name); // switch to calcChecksumi to make case-insensitive
-}
-
-std::string* Jupiter::HTTP::Server::Content::execute(std::string_view query_string) {
-	return Jupiter::HTTP::Server::Content::function(query_string);
-}
-
-// HTTP::Server::Directory
-
-Jupiter::HTTP::Server::Directory::Directory(std::string in_name)
-	: name(std::move(in_name)) {
-	name_checksum = calc_checksum(name);
-}
+// Precomputed response blocks; status blocks are indexed by HTTPVersion, and end with the Date header name
 
-Jupiter::HTTP::Server::Directory::~Directory() {
+static size_t version_index(HTTPVersion in_version) {
+	return in_version == HTTPVersion::HTTP_1_1 ? 1 : 0;
 }
 
-// host/dir/content
-// .hook("dir/subdir/", content)
-
-void Jupiter::HTTP::Server::Directory::hook(std::string_view in_name, std::unique_ptr<Content> in_content) {
-	std::string_view in_name_ref = in_name;
-	size_t in_name_start = in_name_ref.find_first_not_of('/');
+static constexpr std::string_view s_ok_status_block[]{
+	"HTTP/1.0 200 OK" HTTP_ENDL HTTP_SERVER_HEADER "Date: "sv,
+	"HTTP/1.1 200 OK" HTTP_ENDL HTTP_SERVER_HEADER "Date: "sv
+};
 
-	if (in_name_start == std::string_view::npos) { // Hook content
-		content.push_back(std::move(in_content));
-		return;
-	}
-	in_name_ref.remove_prefix(in_name_start);
+static constexpr std::string_view s_not_modified_status_block[]{
+	"HTTP/1.0 304 Not Modified" HTTP_ENDL HTTP_SERVER_HEADER "Date: "sv,
+	"HTTP/1.1 304 Not Modified" HTTP_ENDL HTTP_SERVER_HEADER "Date: "sv
+};
 
-	size_t in_name_end = in_name_ref.find('/');
-	std::string_view dir_name;
-	if (in_name_end == std::string_view::npos) {
-		dir_name = in_name_ref;
-	}
-	else {
-		dir_name = in_name_ref.substr(size_t{ 0 }, in_name_end);
-	}
+static constexpr std::string_view s_partial_content_status_block[]{
+	"HTTP/1.0 206 Partial Content" HTTP_ENDL HTTP_SERVER_HEADER "Date: "sv,
+	"HTTP/1.1 206 Partial Content" HTTP_ENDL HTTP_SERVER_HEADER "Date: "sv
+};
 
-	in_name_ref.remove_prefix(dir_name.size());
-	unsigned int dir_name_checksum = calc_checksum(dir_name);
-	for (auto& directory : directories) {
-		if (directory->name_checksum == dir_name_checksum && directory->name == dir_name) {
-			directory->hook(in_name_ref, std::move(in_content));
-			return;
-		}
+static constexpr std::string_view s_range_not_satisfiable_block[][2]{ // [version][keep_alive]
+	{
+		"HTTP/1.0 416 Range Not Satisfiable" HTTP_ENDL HTTP_SERVER_HEADER "Content-Length: 0" HTTP_ENDL "Connection: close" HTTP_ENDL "Date: "sv,
+		"HTTP/1.0 416 Range Not Satisfiable" HTTP_ENDL HTTP_SERVER_HEADER "Content-Length: 0" HTTP_ENDL "Connection: keep-alive" HTTP_ENDL "Date: "sv
+	},
+	{
+		"HTTP/1.1 416 Range Not Satisfiable" HTTP_ENDL HTTP_SERVER_HEADER "Content-Length: 0" HTTP_ENDL "Connection: close" HTTP_ENDL "Date: "sv,
+		"HTTP/1.1 416 Range Not Satisfiable" HTTP_ENDL HTTP_SERVER_HEADER "Content-Length: 0" HTTP_ENDL "Connection: keep-alive" HTTP_ENDL "Date: "sv
 	}
+};
 
-	// create directories
-	Directory* directory = directories.emplace_back(std::make_unique<Directory>(static_cast<std::string>(dir_name))).get();
-
-directory_add_loop: // TODO: for the love of god, why why why
-	in_name_start = in_name_ref.find_first_not_of('/');
-	if (in_name_start != std::string_view::npos) {
-		in_name_ref.remove_prefix(in_name_start);
-
-		// add directory
-		size_t index = in_name_ref.find('/');
-		if (index != std::string_view::npos) {
-			directory->directories.push_back(std::make_unique<Directory>(static_cast<std::string>(in_name_ref.substr(size_t{ 0 }, index))));
-			directory = directory->directories[directories.size() - 1].get();
-			in_name_ref.remove_prefix(index + 1);
-			goto directory_add_loop;
-		}
-		directory->directories.push_back(std::make_unique<Directory>(static_cast<std::string>(in_name_ref)));
-		directory = directory->directories[directories.size() - 1].get();
+static constexpr std::string_view s_not_found_block[][2]{ // [version][keep_alive]
+	{
+		"HTTP/1.0 404 Not Found" HTTP_ENDL HTTP_SERVER_HEADER "Content-Length: 0" HTTP_ENDL "Connection: close" HTTP_ENDL "Date: "sv,
+		"HTTP/1.0 404 Not Found" HTTP_ENDL HTTP_SERVER_HEADER "Content-Length: 0" HTTP_ENDL "Connection: keep-alive" HTTP_ENDL "Date: "sv
+	},
+	{
+		"HTTP/1.1 404 Not Found" HTTP_ENDL HTTP_SERVER_HEADER "Content-Length: 0" HTTP_ENDL "Connection: close" HTTP_ENDL "Date: "sv,
+		"HTTP/1.1 404 Not Found" HTTP_ENDL HTTP_SERVER_HEADER "Content-Length: 0" HTTP_ENDL "Connection: keep-alive" HTTP_ENDL "Date: "sv
 	}
+};
 
-	// add content
-	directory->content.push_back(std::move(in_content));
-}
+// Malformed requests always close the connection, and we may not know the version
+static constexpr std::string_view s_bad_request_block = "HTTP/1.0 400 Bad Request" HTTP_ENDL HTTP_SERVER_HEADER "Content-Length: 0" HTTP_ENDL "Connection: close" HTTP_ENDL "Date: "sv;
 
-bool Jupiter::HTTP::Server::Directory::remove(std::string_view path, std::string_view content_name) {
-	std::string_view in_name_ref = path;
-	size_t in_name_start = in_name_ref.find_first_not_of('/');
+static constexpr std::string_view s_connection_block[]{ // [keep_alive]
+	"Connection: close" HTTP_ENDL ""sv,
+	"Connection: keep-alive" HTTP_ENDL ""sv
+};
 
-	if (in_name_start == std::string_view::npos) { // Remove content
-		unsigned int checksum = calc_checksum(content_name);
-		for (auto itr = content.begin(); itr != content.end(); ++itr) {
-			auto& content_node = *itr;
-			if (content_node->name_checksum == checksum && content_node->name == content_name) {
-				content.erase(itr);
-				return true;
-			}
-		}
+static constexpr std::string_view s_end_of_headers = HTTP_ENDL ""sv;
 
-		return false;
-	}
-	in_name_ref.remove_prefix(in_name_start);
+static constexpr std::string_view s_chunked_block = "Transfer-Encoding: chunked" HTTP_ENDL HTTP_ENDL ""sv;
+static constexpr std::string_view s_last_chunk = "0" HTTP_ENDL HTTP_ENDL ""sv;
 
-	// Call remove() on next directory in path
-	size_t index = in_name_ref.find('/');
-	std::string_view dir_name;
-	if (index == std::string_view::npos)
-		dir_name = in_name_ref;
-	else
-		dir_name = in_name_ref.substr(size_t{ 0 }, index);
+// Upper bound on how much of a streamed body or file is sent for one session before servicing others
+static constexpr size_t s_max_stream_burst = 256 * 1024;
 
-	in_name_ref.remove_prefix(dir_name.size());
-	unsigned int checksum = calc_checksum(dir_name);
-	for (auto& directory : directories) {
-		if (directory->name_checksum == checksum && directory->name == dir_name) {
-			return directory->remove(in_name_ref, content_name);
-		}
-	}
-	return false;
-}
+// Output buffers with more capacity than this are freed once drained, rather than kept around for the next response
+static constexpr size_t s_max_idle_output_capacity = 64 * 1024;
 
-bool Jupiter::HTTP::Server::Directory::has(std::string_view in_name) {
-	return find(in_name) != nullptr;
+/**
+* @brief Formats a time as an IMF-fixdate; i.e: "Sun, 06 Nov 1994 08:49:37 GMT"
+*
+* @param in_time Time to format
+* @param out_buffer Buffer to write to; must hold at least 30 characters
+* @param in_buffer_size Size of out_buffer
+* @return Number of characters written
+*/
+static size_t format_http_date(time_t in_time, char* out_buffer, size_t in_buffer_size) {
+	tm time_tm{};
+#if defined _WIN32
+	gmtime_s(&time_tm, &in_time);
+#else // _WIN32
+	gmtime_r(&in_time, &time_tm);
+#endif // _WIN32
+	return strftime(out_buffer, in_buffer_size, "%a, %d %b %Y %H:%M:%S GMT", &time_tm);
 }
 
-Jupiter::HTTP::Server::Content *Jupiter::HTTP::Server::Directory::find(std::string_view in_name) {
-	std::string_view in_name_ref = in_name;
-	while (!in_name_ref.empty() && in_name_ref.front() == '/') {
-		in_name.remove_prefix(1);
-	}
+// HTTPDateCache class
 
-	size_t index = in_name_ref.find('/');
-	if (index == std::string_view::npos) { // Search content
-		unsigned int content_name_checksum = calc_checksum(in_name_ref);
-		index = content.size();
-		for (auto& content_item : content) {
-			if (content_item->name_checksum == content_name_checksum && content_item->name == in_name_ref) {
-				return content_item.get();
-			}
+/**
+* @brief Caches the value of the Date header, which only changes once per second.
+* This is thread_local, since worker threads generate responses concurrently.
+*/
+class HTTPDateCache {
+public:
+	/**
+	* @brief Fetches the current date as an IMF-fixdate, followed by a line ending.
+	*
+	* @return Date header value
+	*/
+	std::string_view get() {
+		time_t now = time(nullptr);
+		if (now != m_time) {
+			m_time = now;
+			m_size = format_http_date(now, m_buffer, sizeof(m_buffer) - 2);
+			std::memcpy(m_buffer + m_size, HTTP_ENDL, 2);
+			m_size += 2;
 		}
-		return nullptr; // No such content
-	}
-
-	// Just use split_once?
-	std::string_view dir_name(in_name_ref.data(), index);
-	in_name_ref.remove_prefix(dir_name.size() + 1);
-	unsigned int dir_name_checksum = calc_checksum(dir_name);
 
-	for (auto& directory : directories) {
-		if (directory->name_checksum == dir_name_checksum && directory->name == dir_name) {
-			return directory->find(in_name_ref);
-		}
+		return { m_buffer, m_size };
 	}
 
-	return nullptr; // No such directory
-}
-
-std::string* Jupiter::HTTP::Server::Directory::execute(std::string_view in_name, std::string_view query_string) {
-	Jupiter::HTTP::Server::Content *content_ptr = find(in_name);
-	if (content_ptr == nullptr)
-		return nullptr;
-
-	return content_ptr->execute(query_string);
-}
-
-// HTTP::Server::Host
+private:
+	time_t m_time{};
+	char m_buffer[64]{};
+	size_t m_size{};
+};
 
-Jupiter::HTTP::Server::Host::Host(std::string in_name)
-	: Directory(std::move(in_name)) {
-	name_checksum = calc_checksumi(name);
-}
+thread_local HTTPDateCache s_date_cache;
 
-// HTTPSession struct
+// HTTPRequest struct
 
-struct HTTPSession {
-	Jupiter::Socket sock;
-	std::string request;
-	bool keep_alive = false;
-	Jupiter::HTTP::Server::Host* host = nullptr;
+struct HTTPRequest {
+	HTTPCommand command = HTTPCommand::NONE_SPECIFIED;
 	HTTPVersion version = HTTPVersion::HTTP_1_0;
-	std::chrono::steady_clock::time_point last_active = std::chrono::steady_clock::now();
-	HTTPSession(Jupiter::Socket&& in_sock);
-	~HTTPSession();
+	bool keep_alive = false;
+	std::string_view path; // Request target, without query string
+	std::string_view query_string; // Request target after '?', if any
+	std::string_view host; // Host header, if any
+	std::string_view if_none_match; // If-None-Match header, if any
+	std::string_view if_modified_since; // If-Modified-Since header, if any
+	std::string_view range; // Range header, if any
 };
 
-HTTPSession::HTTPSession(Jupiter::Socket&& in_sock)
-	: sock(std::move(in_sock)) {
-}
-
-HTTPSession::~HTTPSession() {
-}
+// HTTPRequestParser class
 
-// Server::Data struct
+/**
+* @brief Resumable HTTP request parser.
+* The parser remembers how far it's scanned between calls, so each byte of a request is only examined once, no matter
+* how many reads it arrives over. Fields are stored as offsets, since the buffer being parsed may be reallocated
+* between calls, and are converted to views over the buffer once the request is complete.
+*/
+class HTTPRequestParser {
+public:
+	enum class State {
+		INCOMPLETE, // Need more data
+		COMPLETE, // Request line and headers have been parsed; see request() and size()
+		ERROR // Malformed request
+	};
 
-struct Jupiter::HTTP::Server::Data {
-	/** Data */
-	std::vector<std::unique_ptr<Jupiter::HTTP::Server::Host>> m_hosts; // TODO: remove heap allocation, requires move semantics
-	std::vector<std::unique_ptr<Socket>> m_ports; // TODO: remove heap allocation, sockets are already pimpl
-	std::vector<std::unique_ptr<HTTPSession>> m_sessions; // TODO: consider removing heap allocation
-	std::chrono::milliseconds session_timeout = std::chrono::milliseconds(2000); // TODO: Config variable
-	std::chrono::milliseconds keep_alive_session_timeout = std::chrono::milliseconds(5000); // TODO: Config variable
-	size_t max_request_size = 8192; // TODO: Config variable
-	bool permit_keept_alive = true; // TODO: Config variable
+	/**
+	* @brief Resumes parsing the request at the start of a buffer.
+	*
+	* @param in_buffer Buffer starting at the first byte of the request; must have the same prefix as previous calls
+	* @return Current parsing state
+	*/
+	State parse(std::string_view in_buffer);
+
+	/**
+	* @brief Fetches the parsed request. Only valid when parse() returns COMPLETE.
+	*
+	* @param in_buffer Buffer which was last passed to parse()
+	* @return Parsed request, with views over in_buffer
+	*/
+	HTTPRequest request(std::string_view in_buffer) const;
+
+	/**
+	* @brief Fetches the number of bytes in the completed request, including the request line and headers.
+	*
+	* @return Size of the request
+	*/
+	size_t size() const { return m_offset; }
+
+	/**
+	* @brief Resets the parser to begin parsing a new request.
+	*/
+	void reset() { *this = HTTPRequestParser{}; }
+
+private:
+	struct Span {
+		size_t offset{};
+		size_t size{};
+		std::string_view view(std::string_view in_buffer) const { return in_buffer.substr(offset, size); }
+	};
 
-	/** Foward functions */
-	void hook(std::string_view host, std::string_view path, std::unique_ptr<Content> in_content);
-	bool remove(std::string_view hostname);
-	//bool remove(std::string_view hostname, std::string_view path);
-	bool remove(std::string_view hostname, std::string_view path, std::string_view name);
-	bool has(std::string_view hostname);
-	bool has(std::string_view hostname, std::string_view name);
-	Jupiter::HTTP::Server::Host *find_host(std::string_view name);
-	Content* find(std::string_view name);
-	Content* find(std::string_view hostname, std::string_view name);
-	std::string* execute(std::string_view name, std::string_view query_string);
-	std::string* execute(std::string_view hostname, std::string_view name, std::string_view query_string);
+	bool parse_request_line(std::string_view in_line, size_t in_line_offset);
+	void parse_header(std::string_view in_line, size_t in_line_offset);
+
+	enum class Section {
+		REQUEST_LINE,
+		HEADERS,
+		DONE
+	} m_section = Section::REQUEST_LINE;
+	size_t m_offset = 0; // Start of the next unparsed line
+	HTTPCommand m_command = HTTPCommand::NONE_SPECIFIED;
+	HTTPVersion m_version = HTTPVersion::HTTP_1_0;
+	bool m_keep_alive = false;
+	Span m_path;
+	Span m_query_string;
+	Span m_host;
+	Span m_if_none_match;
+	Span m_if_modified_since;
+	Span m_range;
+};
 
-	int process_request(HTTPSession &session);
+HTTPRequestParser::State HTTPRequestParser::parse(std::string_view in_buffer) {
+	while (m_section != Section::DONE) {
+		// Find the end of the next line; everything before m_offset has already been parsed
+		const char* line_end = static_cast<const char*>(std::memchr(in_buffer.data() + m_offset, '\n', in_buffer.size() - m_offset));
+		if (line_end == nullptr) {
+			return State::INCOMPLETE;
+		}
 
-	/** Constructors */
-	Data();
-	Data(const Data &source) = delete;
-	Data(Data &&source) = delete;
+		size_t line_offset = m_offset;
+		std::string_view line{ in_buffer.data() + line_offset, static_cast<size_t>(line_end - in_buffer.data()) - line_offset };
+		m_offset += line.size() + 1;
+		if (!line.empty() && line.back() == '\r') {
+			line.remove_suffix(1);
+		}
 
-	/** Destructor */
-	~Data();
-};
+		if (m_section == Section::REQUEST_LINE) {
+			if (line.empty()) { // Permit (and ignore) empty lines preceding a request
+				continue;
+			}
 
-// Data constructor
+			if (!parse_request_line(line, line_offset)) {
+				return State::ERROR;
+			}
+			m_section = Section::HEADERS;
+		}
+		else if (line.empty()) { // end of http request
+			m_section = Section::DONE;
+		}
+		else {
+			parse_header(line, line_offset);
+		}
+	}
 
-Jupiter::HTTP::Server::Data::Data() {
-	// hosts[0] is always the "global" namespace.
-	m_hosts.push_back(std::make_unique<Host>(""s));
+	return State::COMPLETE;
 }
 
-// Data destructor
-
-Jupiter::HTTP::Server::Data::~Data() {
+HTTPRequest HTTPRequestParser::request(std::string_view in_buffer) const {
+	HTTPRequest result;
+	result.command = m_command;
+	result.version = m_version;
+	result.keep_alive = m_keep_alive;
+	result.path = m_path.view(in_buffer);
+	result.query_string = m_query_string.view(in_buffer);
+	result.host = m_host.view(in_buffer);
+	result.if_none_match = m_if_none_match.view(in_buffer);
+	result.if_modified_since = m_if_modified_since.view(in_buffer);
+	result.range = m_range.view(in_buffer);
+	return result;
 }
 
-// Data functions
+// METHOD SP request-target SP HTTP-version
+bool HTTPRequestParser::parse_request_line(std::string_view in_line, size_t in_line_offset) {
+	size_t method_end = in_line.find(' ');
+	if (method_end == std::string_view::npos) {
+		return false;
+	}
 
-void Jupiter::HTTP::Server::Data::hook(std::string_view hostname, std::string_view in_path, std::unique_ptr<Content> in_content) {
-	Jupiter::HTTP::Server::Host* host = find_host(hostname);
+	std::string_view method = in_line.substr(0, method_end);
+	if (method == "GET"sv) {
+		m_command = HTTPCommand::GET;
+	}
+	else if (method == "HEAD"sv) {
+		m_command = HTTPCommand::HEAD;
+	}
+	else {
+		m_command = HTTPCommand::UNKNOWN;
+	}
 
-	if (host == nullptr) {
-		//host = new Jupiter::HTTP::Server::Host(hostname);
-		host = m_hosts.emplace_back(std::make_unique<Host>(static_cast<std::string>(hostname))).get();
-		// OPTIMIZE: create directory tree and return.
+	size_t target_offset = method_end + 1;
+	size_t target_end = in_line.find(' ', target_offset);
+	if (target_end == std::string_view::npos) {
+		target_end = in_line.size(); // HTTP/0.9 style; no version
 	}
 
-	size_t in_path_start = in_path.find_first_not_of('/');
-	if (in_path_start == std::string_view::npos) {
-		host->content.push_back(std::move(in_content));
+	std::string_view target = in_line.substr(target_offset, target_end - target_offset);
+	size_t query_start = target.find('?');
+	if (query_start == std::string_view::npos) {
+		m_path = { in_line_offset + target_offset, target.size() };
 	}
 	else {
-		in_path.remove_prefix(in_path_start);
-		host->hook(in_path, std::move(in_content));
+		m_path = { in_line_offset + target_offset, query_start };
+		m_query_string = { in_line_offset + target_offset + query_start + 1, target.size() - query_start - 1 };
 	}
-}
 
-bool Jupiter::HTTP::Server::Data::remove(std::string_view hostname) {
-	unsigned int name_checksum = calc_checksumi(hostname);
-	for (auto host_itr = m_hosts.begin(); host_itr != m_hosts.end(); ++host_itr) {
-		if (name_checksum == (*host_itr)->name_checksum && jessilib::equalsi((*host_itr)->name, hostname)) {
-			m_hosts.erase(host_itr);
-			return true;
-		}
+	std::string_view protocol_str = in_line.substr(std::min(target_end + 1, in_line.size()));
+	if (jessilib::equalsi(protocol_str, "http/1.1"sv)) {
+		m_version = HTTPVersion::HTTP_1_1;
+		m_keep_alive = true; // HTTP/1.1 connections are persistent by default
 	}
-	return false;
+	else {
+		m_version = HTTPVersion::HTTP_1_0;
+	}
+
+	return true;
 }
 
-// name: path/to/resource OR path/
-bool Jupiter::HTTP::Server::Data::remove(std::string_view hostname, std::string_view path, std::string_view name) {
-	Jupiter::HTTP::Server::Host *host = find_host(hostname);
-	if (host == nullptr) {
-		return false;
+// field-name ":" OWS field-value OWS
+void HTTPRequestParser::parse_header(std::string_view in_line, size_t in_line_offset) {
+	size_t name_end = in_line.find(':');
+	if (name_end == std::string_view::npos) {
+		return; // Not a header field; ignore it
 	}
-	return host->remove(path, name);
-}
 
-bool Jupiter::HTTP::Server::Data::has(std::string_view hostname) {
-	unsigned int name_checksum = calc_checksumi(hostname);
-	for (const auto& host : m_hosts) {
-		if (name_checksum == host->name_checksum && jessilib::equalsi(host->name, hostname)) {
-			return true;
-		}
+	std::string_view name = in_line.substr(0, name_end);
+	size_t value_offset = name_end + 1;
+	while (value_offset != in_line.size() && (in_line[value_offset] == ' ' || in_line[value_offset] == '\t')) {
+		++value_offset;
 	}
 
-	return false;
-}
+	std::string_view value = in_line.substr(value_offset);
+	while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) {
+		value.remove_suffix(1);
+	}
 
-bool Jupiter::HTTP::Server::Data::has(std::string_view hostname, std::string_view name) {
-	unsigned int name_checksum = calc_checksumi(hostname);
-	for (const auto& host : m_hosts) {
-		if (name_checksum == host->name_checksum && jessilib::equalsi(host->name, hostname)) {
-			name_checksum = calc_checksum(name); // switch to equalsi to make case-insensitive
-			for (const auto& content : host->content) {
-				if (name_checksum == content->name_checksum && content->name == name) { // switch to equalsi to make case-insensitive
-					return true;
-				}
-			}
-			return false;
+	if (jessilib::equalsi(name, "Host"sv)) {
+		m_host = { in_line_offset + value_offset, value.size() };
+	}
+	else if (jessilib::equalsi(name, "If-None-Match"sv)) {
+		m_if_none_match = { in_line_offset + value_offset, value.size() };
+	}
+	else if (jessilib::equalsi(name, "If-Modified-Since"sv)) {
+		m_if_modified_since = { in_line_offset + value_offset, value.size() };
+	}
+	else if (jessilib::equalsi(name, "Range"sv)) {
+		m_range = { in_line_offset + value_offset, value.size() };
+	}
+	else if (jessilib::equalsi(name, "Connection"sv)) {
+		if (jessilib::equalsi(value, "keep-alive"sv)) {
+			m_keep_alive = true;
+		}
+		else if (jessilib::equalsi(value, "close"sv)) {
+			m_keep_alive = false;
 		}
 	}
-	return false;
 }
 
-Jupiter::HTTP::Server::Host *Jupiter::HTTP::Server::Data::find_host(std::string_view name) {
-	unsigned int name_checksum = calc_checksumi(name);
-	for (const auto& host : m_hosts) {
-		if (name_checksum == host->name_checksum && host->name == name) {
-			return host.get();
-		}
-	}
+// HTTP::Server::Content
 
-	return nullptr;
+Jupiter::HTTP::Server::Content::Content(std::string in_name, Jupiter::HTTP::Server::HTTPFunction in_function)
+	: name(std::move(in_name)) {
+	Jupiter::HTTP::Server::Content::function = in_function;
+	update_headers();
 }
 
-Jupiter::HTTP::Server::Content *Jupiter::HTTP::Server::Data::find(std::string_view name) {
-	return m_hosts[0]->find(name);
+Jupiter::HTTP::Server::Content::Content(std::string in_name, Jupiter::HTTP::Server::HTTPStreamFunction in_function)
+	: name(std::move(in_name)) {
+	Jupiter::HTTP::Server::Content::stream_function = in_function;
+	update_headers();
 }
 
-Jupiter::HTTP::Server::Content *Jupiter::HTTP::Server::Data::find(std::string_view hostname, std::string_view name) {
-	Jupiter::HTTP::Server::Host *host = find_host(hostname);
-	if (host == nullptr)
+std::string* Jupiter::HTTP::Server::Content::execute(std::string_view query_string) {
+	if (Jupiter::HTTP::Server::Content::function == nullptr) {
 		return nullptr;
+	}
 
-	return host->find(name);
+	return Jupiter::HTTP::Server::Content::function(query_string);
 }
 
-std::string* Jupiter::HTTP::Server::Data::execute(std::string_view name, std::string_view query_string) {
-	Jupiter::HTTP::Server::Content *content = find(name);
-	if (content == nullptr)
+Jupiter::HTTP::Server::HTTPStreamProducer Jupiter::HTTP::Server::Content::stream(std::string_view query_string) {
+	if (Jupiter::HTTP::Server::Content::stream_function == nullptr) {
 		return nullptr;
+	}
 
-	return content->execute(query_string);
+	return Jupiter::HTTP::Server::Content::stream_function(query_string);
 }
 
-std::string* Jupiter::HTTP::Server::Data::execute(std::string_view hostname, std::string_view name, std::string_view query_string) {
-	Jupiter::HTTP::Server::Content *content = find(hostname, name);
-	if (content == nullptr)
-		return nullptr;
-
-	return content->execute(query_string);
+Jupiter::HTTP::Server::HTTPStreamProducer Jupiter::HTTP::Server::Content::stream(std::string_view query_string, HTTPStreamResume) {
+	return stream(query_string);
 }
 
-char* html_time() {
-	time_t rawtime = time(0);
-	char *rtime = new char[64];
-	strftime(rtime, 64, "%a, %d %b %Y %H:%M:%S GMT", gmtime(&rawtime));
-	return rtime;
+bool Jupiter::HTTP::Server::Content::is_streamed() const {
+	return Jupiter::HTTP::Server::Content::stream_function != nullptr;
 }
 
-int Jupiter::HTTP::Server::Data::process_request(HTTPSession &session) {
-	auto lines = jessilib::split_view(session.request, "\r\n"sv);
-	HTTPCommand command = HTTPCommand::NONE_SPECIFIED;
-	Content *content = nullptr;
-	std::string_view query_string;
-	std::string_view first_token;
-	size_t index = 0;
-	size_t span;
+void Jupiter::HTTP::Server::Content::update_headers() {
+	headers = "Content-Type: "sv;
+	if (type.empty()) {
+		headers += Jupiter::HTTP::Content::Type::Text::PLAIN;
+	}
+	else {
+		headers += type;
+	}
 
-	auto get_line_offset = [&session, &lines](size_t index)
-	{
-		size_t offset = 0;
-		while (index != 0)
-			offset += lines[--index].size() + 2;
-		return offset;
-	};
+	if (!charset.empty()) {
+		headers += "; charset="sv;
+		headers += charset;
+	}
+	headers += HTTP_ENDL;
 
-	while (index != lines.size())
-	{
-		std::string_view line = lines[index++];
+	if (!language.empty()) {
+		headers += "Content-Language: "sv;
+		headers += language;
+		headers += HTTP_ENDL;
+	}
+}
+
+// LRUMap class
 
-		// trim front-end spaces.
-		while (!line.empty() && line.front() == ' ') {
-			line.remove_prefix(1);
+/**
+* @brief Least recently used map of shared, immutable values, keyed by string. This is not thread-safe.
+* Values are shared, so that a value in use stays valid even if it's evicted.
+*/
+template<typename ValueT>
+class LRUMap {
+public:
+	using value_ptr = std::shared_ptr<const ValueT>;
+
+	/**
+	* @brief Fetches a value, and marks it as most recently used.
+	*
+	* @param in_key Key to search for
+	* @return Value if one exists, nullptr otherwise
+	*/
+	value_ptr find(std::string_view in_key) {
+		auto itr = m_index.find(in_key);
+		if (itr == m_index.end()) {
+			return nullptr;
 		}
 
-		if (!line.empty()) // end of http request
-		{
-			std::string result;
-			result.reserve(256);
-			switch (command)
-			{
-			case HTTPCommand::GET:
-			case HTTPCommand::HEAD:
-				if (content != nullptr)
-				{
-					// 200 (success)
-					// TODO: remove referencestring warpper
-					std::string* content_result = content->execute(query_string);
-
-					switch (session.version)
-					{
-					default:
-					case HTTPVersion::HTTP_1_0:
-						result = "HTTP/1.0 200 OK"sv HTTP_ENDL;
-						break;
-					case HTTPVersion::HTTP_1_1:
-						result = "HTTP/1.1 200 OK"sv HTTP_ENDL;
-						break;
-					}
+		m_entries.splice(m_entries.begin(), m_entries, itr->second);
+		return itr->second->value;
+	}
 
-					result += "Date: "sv;
-					char *time_header = html_time();
-					result += time_header;
-					delete[] time_header;
-					result += HTTP_ENDL;
-
-					result += "Server: "sv JUPITER_VERSION HTTP_ENDL;
-					result += "Content-Length: "sv;
-					result += std::to_string(content_result->size()); // TODO: to_chars?
-					result += HTTP_ENDL;
-
-					if (session.keep_alive)
-						result += "Connection: keep-alive"sv HTTP_ENDL;
-					else
-						result += "Connection: close"sv HTTP_ENDL;
-
-					result += "Content-Type: "sv;
-					if (content->type.empty()) {
-						result += Jupiter::HTTP::Content::Type::Text::PLAIN;
+	/**
+	* @brief Inserts or replaces a value, evicting the least recently used values until the total cost fits.
+	* Values costing more than in_max_cost aren't inserted.
+	*
+	* @param in_key Key to insert at
+	* @param in_value Value to insert
+	* @param in_cost Cost of the value (i.e: its size)
+	* @param in_max_cost Upper bound on the total cost of all values
+	*/
+	void insert(std::string_view in_key, value_ptr in_value, size_t in_cost, size_t in_max_cost) {
+		erase(in_key);
+		if (in_cost > in_max_cost) {
+			return;
+		}
+
+		while (m_cost + in_cost > in_max_cost) {
+			erase(std::prev(m_entries.end()));
+		}
+
+		m_entries.push_front(Entry{ static_cast<std::string>(in_key), std::move(in_value), in_cost });
+		m_index.emplace(m_entries.front().key, m_entries.begin());
+		m_cost += in_cost;
+	}
+
+	/**
+	* @brief Removes a value, if one exists.
+	*
+	* @param in_key Key to remove
+	*/
+	void erase(std::string_view in_key) {
+		auto itr = m_index.find(in_key);
+		if (itr != m_index.end()) {
+			erase(itr->second);
+		}
+	}
+
+private:
+	struct Entry {
+		std::string key;
+		value_ptr value;
+		size_t cost;
+	};
+
+	void erase(typename std::list<Entry>::iterator in_entry) {
+		m_cost -= in_entry->cost;
+		m_index.erase(in_entry->key);
+		m_entries.erase(in_entry);
+	}
+
+	std::list<Entry> m_entries; // Most recently used first
+	std::unordered_map<std::string_view, typename std::list<Entry>::iterator> m_index; // Keys are views of Entry::key
+	size_t m_cost = 0;
+};
+
+// HTTP::Server::Content::Cache
+
+/**
+* @brief Cache of generated responses, keyed by query string.
+*/
+struct Jupiter::HTTP::Server::Content::Cache {
+	struct Response {
+		std::string body;
+		std::string etag_header; // ETag header line
+		std::string_view etag; // Quoted entity tag, within etag_header
+		std::chrono::steady_clock::time_point expires;
+	};
+
+	/**
+	* @brief Fetches an unexpired response, and marks it as most recently used.
+	*
+	* @param query_string Query string the response was generated for
+	* @return Cached response if one exists, nullptr otherwise
+	*/
+	std::shared_ptr<const Response> find(std::string_view query_string);
+
+	/**
+	* @brief Caches a newly generated response, evicting the least recently used responses to make room.
+	* Responses larger than max_size are returned, but not cached.
+	*
+	* @param query_string Query string the response was generated for
+	* @param in_body Generated response body
+	* @return Response for in_body
+	*/
+	std::shared_ptr<const Response> insert(std::string_view query_string, std::string in_body);
+
+	std::chrono::milliseconds ttl{};
+	size_t max_size{};
+	LRUMap<Response> responses; // Cost is the size of the query string & body
+	std::mutex mutex;
+};
+
+std::shared_ptr<const Jupiter::HTTP::Server::Content::Cache::Response> Jupiter::HTTP::Server::Content::Cache::find(std::string_view query_string) {
+	std::lock_guard guard{ mutex };
+	auto response = responses.find(query_string);
+	if (response != nullptr && std::chrono::steady_clock::now() >= response->expires) {
+		responses.erase(query_string);
+		return nullptr;
+	}
+
+	return response;
+}
+
+std::shared_ptr<const Jupiter::HTTP::Server::Content::Cache::Response> Jupiter::HTTP::Server::Content::Cache::insert(std::string_view query_string, std::string in_body) {
+	auto response = std::make_shared<Response>();
+	response->body = std::move(in_body);
+	response->expires = std::chrono::steady_clock::now() + ttl;
+
+	// Entity tag is a 64-bit FNV-1a hash of the body
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (unsigned char chr : response->body) {
+		hash = (hash ^ chr) * 0x100000001b3ULL;
+	}
+
+	char etag_header[48] = "ETag: \"";
+	char* etag_end = std::to_chars(etag_header + 7, etag_header + sizeof(etag_header) - 3, hash, 16).ptr;
+	std::memcpy(etag_end, "\"" HTTP_ENDL, 3);
+	response->etag_header.assign(etag_header, etag_end + 3);
+	response->etag = std::string_view{ response->etag_header }.substr(6, etag_end + 1 - (etag_header + 6));
+
+	std::lock_guard guard{ mutex };
+	responses.insert(query_string, response, query_string.size() + response->body.size(), max_size);
+	return response;
+}
+
+// HTTP::Server::Content caching
+
+Jupiter::HTTP::Server::Content::~Content() {
+}
+
+void Jupiter::HTTP::Server::Content::enable_cache(std::chrono::milliseconds in_ttl, size_t in_max_size) {
+	cache = std::make_unique<Cache>();
+	cache->ttl = in_ttl;
+	cache->max_size = in_max_size;
+}
+
+void Jupiter::HTTP::Server::Content::disable_cache() {
+	cache.reset();
+}
+
+// If-None-Match is either "*", or a comma-separated list of entity tags; weak tags compare equal to strong ones here
+static bool etag_matches(std::string_view in_if_none_match, std::string_view in_etag) {
+	while (!in_if_none_match.empty()) {
+		std::string_view tag = in_if_none_match.substr(size_t{ 0 }, in_if_none_match.find(','));
+		in_if_none_match.remove_prefix(std::min(tag.size() + 1, in_if_none_match.size()));
+
+		while (!tag.empty() && (tag.front() == ' ' || tag.front() == '\t')) {
+			tag.remove_prefix(1);
+		}
+		while (!tag.empty() && (tag.back() == ' ' || tag.back() == '\t')) {
+			tag.remove_suffix(1);
+		}
+		if (tag.substr(0, 2) == "W/"sv) {
+			tag.remove_prefix(2);
+		}
+
+		if (tag == "*"sv || tag == in_etag) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// HTTP::Server::FileContent::Files
+
+/** File opened by FileContent; closed once it's evicted and no longer being sent */
+struct OpenFile {
+	int fd = -1;
+	uint64_t size{};
+	std::string headers; // Content-Type, Content-Language, Last-Modified, and Accept-Ranges header lines
+	std::string_view last_modified; // Last-Modified value, within headers
+	std::chrono::steady_clock::time_point expires;
+
+	OpenFile() = default;
+	OpenFile(const OpenFile&) = delete;
+	~OpenFile() {
+		if (fd >= 0) {
+#if defined _WIN32
+			_close(fd);
+#else // _WIN32
+			::close(fd);
+#endif // _WIN32
+		}
+	}
+};
+
+/**
+* @brief Cache of files opened by a FileContent, keyed by path beneath the mount.
+*/
+struct Jupiter::HTTP::Server::FileContent::Files {
+	/**
+	* @brief Fetches an open file, opening it if it isn't cached or has expired.
+	*
+	* @param in_content Content being served
+	* @param in_file_path Path of the file beneath in_content.path, or empty for a single file
+	* @return Open file on success, nullptr otherwise
+	*/
+	std::shared_ptr<const OpenFile> open(const FileContent& in_content, std::string_view in_file_path);
+
+	LRUMap<OpenFile> files; // Cost is 1 per file
+	std::mutex mutex;
+};
+
+static constexpr std::pair<std::string_view, std::string_view> s_content_types[]{
+	{ ".html"sv, Jupiter::HTTP::Content::Type::Text::HTML },
+	{ ".htm"sv, Jupiter::HTTP::Content::Type::Text::HTML },
+	{ ".txt"sv, Jupiter::HTTP::Content::Type::Text::PLAIN },
+	{ ".css"sv, Jupiter::HTTP::Content::Type::Text::CSS },
+	{ ".js"sv, Jupiter::HTTP::Content::Type::Text::JAVASCRIPT },
+	{ ".mjs"sv, Jupiter::HTTP::Content::Type::Text::JAVASCRIPT },
+	{ ".csv"sv, Jupiter::HTTP::Content::Type::Text::CSV },
+	{ ".json"sv, Jupiter::HTTP::Content::Type::Application::JSON },
+	{ ".xml"sv, Jupiter::HTTP::Content::Type::Application::XML },
+	{ ".pdf"sv, Jupiter::HTTP::Content::Type::Application::PDF },
+	{ ".zip"sv, Jupiter::HTTP::Content::Type::Application::ZIP },
+	{ ".wasm"sv, Jupiter::HTTP::Content::Type::Application::WASM },
+	{ ".png"sv, Jupiter::HTTP::Content::Type::Image::PNG },
+	{ ".jpg"sv, Jupiter::HTTP::Content::Type::Image::JPEG },
+	{ ".jpeg"sv, Jupiter::HTTP::Content::Type::Image::JPEG },
+	{ ".gif"sv, Jupiter::HTTP::Content::Type::Image::GIF },
+	{ ".svg"sv, Jupiter::HTTP::Content::Type::Image::SVG },
+	{ ".ico"sv, Jupiter::HTTP::Content::Type::Image::ICON },
+	{ ".webp"sv, Jupiter::HTTP::Content::Type::Image::WEBP },
+	{ ".woff"sv, Jupiter::HTTP::Content::Type::Font::WOFF },
+	{ ".woff2"sv, Jupiter::HTTP::Content::Type::Font::WOFF2 }
+};
+
+static std::string_view content_type_for(const std::filesystem::path& in_path) {
+	std::string extension = in_path.extension().string();
+	for (const auto& content_type : s_content_types) {
+		if (jessilib::equalsi(std::string_view{ extension }, content_type.first)) {
+			return content_type.second;
+		}
+	}
+
+	return Jupiter::HTTP::Content::Type::Application::OCTET_STREAM;
+}
+
+// Mounted paths must stay beneath the mount; reject anything which could escape it, or name a directory
+static bool is_safe_file_path(std::string_view in_file_path) {
+	if (in_file_path.empty()) {
+		return false;
+	}
+
+	while (true) {
+		std::string_view segment = in_file_path.substr(size_t{ 0 }, in_file_path.find('/'));
+		if (segment.empty() || segment == "."sv || segment == ".."sv
+			|| segment.find_first_of("\\:\0"sv) != std::string_view::npos) {
+			return false;
+		}
+
+		if (segment.size() == in_file_path.size()) {
+			return true;
+		}
+		in_file_path.remove_prefix(segment.size() + 1);
+	}
+}
+
+std::shared_ptr<const OpenFile> Jupiter::HTTP::Server::FileContent::Files::open(const FileContent& in_content, std::string_view in_file_path) {
+	{
+		std::lock_guard guard{ mutex };
+		auto file = files.find(in_file_path);
+		if (file != nullptr) {
+			if (std::chrono::steady_clock::now() < file->expires) {
+				return file;
+			}
+			files.erase(in_file_path);
+		}
+	}
+
+	std::filesystem::path file_path = in_content.path;
+	if (in_content.mount) {
+		if (!is_safe_file_path(in_file_path)) {
+			return nullptr;
+		}
+		file_path /= in_file_path;
+	}
+
+	auto file = std::make_shared<OpenFile>();
+#if defined _WIN32
+	file->fd = _wopen(file_path.c_str(), _O_RDONLY | _O_BINARY | _O_NOINHERIT);
+	struct _stat64 file_stat{};
+	if (file->fd < 0 || _fstat64(file->fd, &file_stat) != 0) {
+		return nullptr;
+	}
+#else // _WIN32
+	file->fd = ::open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
+	struct stat file_stat{};
+	if (file->fd < 0 || fstat(file->fd, &file_stat) != 0) {
+		return nullptr;
+	}
+#endif // _WIN32
+
+	if ((file_stat.st_mode & S_IFMT) != S_IFREG) {
+		return nullptr;
+	}
+	file->size = static_cast<uint64_t>(file_stat.st_size);
+	file->expires = std::chrono::steady_clock::now() + in_content.file_cache_ttl;
+
+	file->headers = "Content-Type: "sv;
+	file->headers += in_content.type.empty() ? content_type_for(file_path) : in_content.type;
+	if (!in_content.charset.empty()) {
+		file->headers += "; charset="sv;
+		file->headers += in_content.charset;
+	}
+	file->headers += HTTP_ENDL;
+
+	if (!in_content.language.empty()) {
+		file->headers += "Content-Language: "sv;
+		file->headers += in_content.language;
+		file->headers += HTTP_ENDL;
+	}
+
+	char last_modified[64];
+	size_t last_modified_size = format_http_date(file_stat.st_mtime, last_modified, sizeof(last_modified));
+	file->headers += "Last-Modified: "sv;
+	size_t last_modified_offset = file->headers.size();
+	file->headers.append(last_modified, last_modified_size);
+	file->headers += HTTP_ENDL "Accept-Ranges: bytes" HTTP_ENDL ""sv;
+	file->last_modified = std::string_view{ file->headers }.substr(last_modified_offset, last_modified_size);
+
+	std::lock_guard guard{ mutex };
+	files.insert(in_file_path, file, 1, in_content.file_cache_size);
+	return file;
+}
+
+// Range is "bytes=first-last", "bytes=first-", or "bytes=-suffix_length"; multiple ranges aren't supported
+enum class RangeState {
+	NONE, // No usable range; send the whole file
+	VALID, // Send the requested range
+	UNSATISFIABLE // Range lies beyond the end of the file
+};
+
+static RangeState parse_range(std::string_view in_range, uint64_t in_size, uint64_t& out_begin, uint64_t& out_end) {
+	if (in_range.substr(0, 6) != "bytes="sv) {
+		return RangeState::NONE;
+	}
+	in_range.remove_prefix(6);
+
+	size_t separator = in_range.find('-');
+	if (separator == std::string_view::npos || in_range.find(',') != std::string_view::npos) {
+		return RangeState::NONE;
+	}
+
+	std::string_view first_str = in_range.substr(0, separator);
+	std::string_view last_str = in_range.substr(separator + 1);
+	uint64_t first{};
+	uint64_t last{};
+	if (!first_str.empty() && std::from_chars(first_str.data(), first_str.data() + first_str.size(), first).ptr != first_str.data() + first_str.size()) {
+		return RangeState::NONE;
+	}
+	if (!last_str.empty() && std::from_chars(last_str.data(), last_str.data() + last_str.size(), last).ptr != last_str.data() + last_str.size()) {
+		return RangeState::NONE;
+	}
+
+	if (first_str.empty()) { // suffix
+		if (last_str.empty()) {
+			return RangeState::NONE;
+		}
+		if (last == 0) {
+			return RangeState::UNSATISFIABLE;
+		}
+
+		out_begin = in_size - std::min(last, in_size);
+		out_end = in_size;
+	}
+	else {
+		if (!last_str.empty() && last < first) {
+			return RangeState::NONE;
+		}
+		if (first >= in_size) {
+			return RangeState::UNSATISFIABLE;
+		}
+
+		out_begin = first;
+		out_end = last_str.empty() ? in_size : std::min(last + 1, in_size);
+	}
+
+	return out_begin == out_end ? RangeState::UNSATISFIABLE : RangeState::VALID;
+}
+
+// HTTP::Server::FileContent
+
+Jupiter::HTTP::Server::FileContent::FileContent(std::string in_name, std::filesystem::path in_path, bool in_mount)
+	: Content(std::move(in_name), static_cast<HTTPFunction*>(nullptr)),
+	path(std::move(in_path)),
+	mount(in_mount),
+	files(std::make_unique<Files>()) {
+}
+
+Jupiter::HTTP::Server::FileContent::~FileContent() {
+}
+
+std::string* Jupiter::HTTP::Server::FileContent::execute(std::string_view) {
+	if (mount) {
+		return nullptr;
+	}
+
+	std::ifstream file{ path, std::ios::in | std::ios::binary };
+	if (!file) {
+		return nullptr;
+	}
+
+	return new std::string{ std::istreambuf_iterator<char>{ file }, std::istreambuf_iterator<char>{} };
+}
+
+// HTTP::Server::Directory
+
+Jupiter::HTTP::Server::Directory::Directory(std::string in_name)
+	: name(std::move(in_name)) {
+}
+
+Jupiter::HTTP::Server::Directory::~Directory() {
+}
+
+// host/dir/content
+// .hook("dir/subdir/", content)
+
+void Jupiter::HTTP::Server::Directory::hook(std::string_view in_name, std::unique_ptr<Content> in_content) {
+	Directory* directory = this;
+
+	// Walk (and create, as necessary) each directory in the path
+	while (true) {
+		size_t in_name_start = in_name.find_first_not_of('/');
+		if (in_name_start == std::string_view::npos) { // Hook content
+			directory->content.push_back(std::move(in_content));
+			return;
+		}
+		in_name.remove_prefix(in_name_start);
+
+		std::string_view dir_name = in_name.substr(size_t{ 0 }, in_name.find('/'));
+		in_name.remove_prefix(dir_name.size());
+
+		auto itr = std::find_if(directory->directories.begin(), directory->directories.end(), [dir_name](const std::unique_ptr<Directory>& in_directory) {
+			return in_directory->name == dir_name;
+		});
+		if (itr != directory->directories.end()) {
+			directory = itr->get();
+		}
+		else {
+			directory = directory->directories.emplace_back(std::make_unique<Directory>(static_cast<std::string>(dir_name))).get();
+		}
+	}
+}
+
+bool Jupiter::HTTP::Server::Directory::remove(std::string_view path, std::string_view content_name) {
+	std::string_view in_name_ref = path;
+	size_t in_name_start = in_name_ref.find_first_not_of('/');
+
+	if (in_name_start == std::string_view::npos) { // Remove content
+		for (auto itr = content.begin(); itr != content.end(); ++itr) {
+			auto& content_node = *itr;
+			if (content_node->name == content_name) {
+				content.erase(itr);
+				return true;
+			}
+		}
+
+		return false;
+	}
+	in_name_ref.remove_prefix(in_name_start);
+
+	// Call remove() on next directory in path
+	std::string_view dir_name = in_name_ref.substr(size_t{ 0 }, in_name_ref.find('/'));
+	in_name_ref.remove_prefix(dir_name.size());
+	for (auto& directory : directories) {
+		if (directory->name == dir_name) {
+			return directory->remove(in_name_ref, content_name);
+		}
+	}
+	return false;
+}
+
+bool Jupiter::HTTP::Server::Directory::has(std::string_view in_name) {
+	return find(in_name) != nullptr;
+}
+
+Jupiter::HTTP::Server::Content *Jupiter::HTTP::Server::Directory::find(std::string_view in_name) {
+	std::string_view in_name_ref = in_name;
+	while (!in_name_ref.empty() && in_name_ref.front() == '/') {
+		in_name_ref.remove_prefix(1);
+	}
+
+	size_t index = in_name_ref.find('/');
+	if (index == std::string_view::npos) { // Search content
+		for (auto& content_item : content) {
+			if (content_item->name == in_name_ref) {
+				return content_item.get();
+			}
+		}
+		return nullptr; // No such content
+	}
+
+	std::string_view dir_name(in_name_ref.data(), index);
+	in_name_ref.remove_prefix(dir_name.size() + 1);
+	for (auto& directory : directories) {
+		if (directory->name == dir_name) {
+			return directory->find(in_name_ref);
+		}
+	}
+
+	return nullptr; // No such directory
+}
+
+std::string* Jupiter::HTTP::Server::Directory::execute(std::string_view in_name, std::string_view query_string) {
+	Jupiter::HTTP::Server::Content *content_ptr = find(in_name);
+	if (content_ptr == nullptr)
+		return nullptr;
+
+	return content_ptr->execute(query_string);
+}
+
+// HTTP::Server::Host
+
+Jupiter::HTTP::Server::Host::Host(std::string in_name)
+	: Directory(std::move(in_name)) {
+}
+
+// Route index
+
+/** Transparent hash, so that routes can be looked up by std::string_view */
+struct RouteHash {
+	using is_transparent = void;
+	size_t operator()(std::string_view in_path) const {
+		return std::hash<std::string_view>{}(in_path);
+	}
+};
+
+/**
+* @brief Every Content hooked under a Host, keyed by its full path.
+* Paths are joined from each non-empty segment, with no leading '/'; i.e: hook("/dir//subdir/", "name") is "dir/subdir/name"
+*/
+struct HostRoutes {
+	Jupiter::HTTP::Server::Host* host;
+	std::unordered_map<std::string, Jupiter::HTTP::Server::Content*, RouteHash, std::equal_to<>> content;
+	std::unordered_map<std::string, Jupiter::HTTP::Server::FileContent*, RouteHash, std::equal_to<>> mounts; // Mounted FileContent, which also serve paths beneath their own
+};
+
+// MPSCQueue class
+
+/**
+* @brief Lock-free multi-producer, single-consumer queue of intrusively linked nodes (via NodeT::next).
+* Producers push onto a stack with a single compare-and-swap; the consumer takes the whole stack at once, and reverses it.
+*/
+template<typename NodeT>
+class MPSCQueue {
+public:
+	/**
+	* @brief Pushes a node onto the queue. This may be called from any thread.
+	*
+	* @param in_node Node to push
+	*/
+	void push(NodeT* in_node) {
+		NodeT* head = m_head.load(std::memory_order_relaxed);
+		do {
+			in_node->next = head;
+		} while (!m_head.compare_exchange_weak(head, in_node, std::memory_order_release, std::memory_order_relaxed));
+	}
+
+	/**
+	* @brief Takes every node from the queue. This must only be called from the consuming thread.
+	*
+	* @return First node pushed, linked to the rest in the order they were pushed; nullptr if the queue is empty
+	*/
+	NodeT* pop_all() {
+		NodeT* node = m_head.exchange(nullptr, std::memory_order_acquire);
+		NodeT* result = nullptr;
+		while (node != nullptr) {
+			NodeT* next = node->next;
+			node->next = result;
+			result = node;
+			node = next;
+		}
+
+		return result;
+	}
+
+private:
+	std::atomic<NodeT*> m_head{ nullptr };
+};
+
+/**
+* @brief Hashed timer wheel of intrusively linked nodes (via NodeT::timer_next & NodeT::timer_link).
+* Deadlines are rounded up to the next tick and hashed into one of SlotCount slots, so a slot may also hold nodes which
+* are due on a later revolution of the wheel. Scheduling & cancelling are O(1); advancing costs one step per elapsed tick,
+* plus one per node in the slots passed.
+*/
+template<typename NodeT, size_t SlotCount = 64>
+class TimerWheel {
+public:
+	using clock = std::chrono::steady_clock;
+	static_assert((SlotCount & (SlotCount - 1)) == 0, "SlotCount must be a power of 2");
+
+	/**
+	* @brief Schedules a node, replacing its current deadline if it's already scheduled.
+	*
+	* @param in_node Node to schedule
+	* @param in_deadline Time at which the node is due
+	*/
+	void schedule(NodeT& in_node, clock::time_point in_deadline) {
+		cancel(in_node);
+
+		// Round up, so that a node is never processed before its deadline
+		int64_t tick = std::max(to_tick(in_deadline) + 1, m_tick + 1);
+		link(in_node, m_slots[tick & (SlotCount - 1)]);
+		++m_size;
+	}
+
+	/**
+	* @brief Removes a node from the wheel, if it's scheduled.
+	*
+	* @param in_node Node to cancel
+	*/
+	void cancel(NodeT& in_node) {
+		if (in_node.timer_link == nullptr) {
+			return;
+		}
+
+		*in_node.timer_link = in_node.timer_next;
+		if (in_node.timer_next != nullptr) {
+			in_node.timer_next->timer_link = in_node.timer_link;
+		}
+		in_node.timer_next = nullptr;
+		in_node.timer_link = nullptr;
+		--m_size;
+	}
+
+	/**
+	* @brief Processes every tick up to the current time, unscheduling each node in the slots passed and handing it to
+	* a callback. Nodes aren't necessarily due yet (see above); the callback is expected to check, and reschedule those
+	* which aren't. The callback may also cancel or destroy other nodes.
+	*
+	* @param in_now Current time
+	* @param in_callback Callback taking a NodeT&
+	*/
+	template<typename CallbackT>
+	void advance(clock::time_point in_now, CallbackT&& in_callback) {
+		int64_t now_tick = to_tick(in_now);
+		int64_t end_tick = std::min(now_tick, m_tick + static_cast<int64_t>(SlotCount));
+		while (m_tick < end_tick) {
+			++m_tick;
+
+			// Detach the slot first, since rescheduled nodes may hash right back into it
+			NodeT*& slot = m_slots[m_tick & (SlotCount - 1)];
+			m_processing = std::exchange(slot, nullptr);
+			if (m_processing != nullptr) {
+				m_processing->timer_link = &m_processing;
+			}
+
+			while (m_processing != nullptr) {
+				NodeT& node = *m_processing;
+				cancel(node);
+				in_callback(node);
+			}
+		}
+
+		m_tick = std::max(m_tick, now_tick);
+	}
+
+	/**
+	* @brief Fetches the time of the next tick with nodes scheduled; those nodes may not be due until a later revolution.
+	*
+	* @return Time of the next occupied tick, or clock::time_point::max() if nothing is scheduled
+	*/
+	clock::time_point next_tick() const {
+		if (m_size != 0) {
+			for (int64_t tick = m_tick + 1; tick <= m_tick + static_cast<int64_t>(SlotCount); ++tick) {
+				if (m_slots[tick & (SlotCount - 1)] != nullptr) {
+					return clock::time_point{ s_tick * tick };
+				}
+			}
+		}
+
+		return clock::time_point::max();
+	}
+
+private:
+	static constexpr clock::duration s_tick = std::chrono::milliseconds(100); // Resolution of deadlines
+
+	static int64_t to_tick(clock::time_point in_time) {
+		return in_time.time_since_epoch() / s_tick;
+	}
+
+	static void link(NodeT& in_node, NodeT*& in_head) {
+		in_node.timer_next = in_head;
+		in_node.timer_link = &in_head;
+		if (in_head != nullptr) {
+			in_head->timer_link = &in_node.timer_next;
+		}
+		in_head = &in_node;
+	}
+
+	NodeT* m_slots[SlotCount]{};
+	NodeT* m_processing = nullptr; // Nodes detached from the slot being processed by advance()
+	int64_t m_tick = to_tick(clock::now()); // Last tick processed
+	size_t m_size = 0;
+};
+
+// HTTPSession struct
+
+/** What a session is waiting on */
+enum class SessionWait {
+	READ, // Next request
+	WRITE, // Socket to accept pending output
+	HANDLER, // Handler thread to process an async request; the session is removed from the event loop meanwhile
+	PAUSED // Stream producer to have more output ready, or the server's buffered output to drain; only hangups are watched for meanwhile
+};
+
+struct HTTPSession;
+
+/** Queue of streams to resume on a worker; shared with each stream's resume function, which may outlive the worker */
+struct StreamResumer {
+	/** Identifies a stream to its resume function */
+	struct Stream {
+		HTTPSession* session; // Cleared by the worker once the stream ends
+	};
+
+	std::mutex mutex;
+	std::vector<std::shared_ptr<Stream>> streams; // Streams to resume; taken by the worker
+	std::function<void()> wake; // Wakes the worker; cleared once the worker is destroyed
+
+	void resume(std::shared_ptr<Stream> in_stream);
+};
+
+void StreamResumer::resume(std::shared_ptr<Stream> in_stream) {
+	std::lock_guard guard{ mutex };
+	if (wake) {
+		streams.push_back(std::move(in_stream));
+		wake();
+	}
+}
+
+struct HTTPSession {
+	std::unique_ptr<Jupiter::Socket> sock; // Created on first use, and replaced if the next listener differs in type
+	Jupiter::SecureSocket* tls = nullptr; // sock, when accepted from a tls_bind() listener
+	bool handshaking = false; // Whether the TLS handshake has yet to complete
+	HTTPRequestParser parser;
+	bool keep_alive = false;
+	bool closing = false; // Close once the current response has been sent
+	HTTPVersion version = HTTPVersion::HTTP_1_0;
+	std::string output; // Response data which the socket hasn't accepted yet
+	size_t output_offset = 0; // Start of the unsent data within `output`
+	size_t output_accounted = 0; // Unsent output counted towards Server::Data::m_buffered_output
+	Jupiter::HTTP::Server::HTTPStreamProducer stream; // Streamed response body in progress, if any
+	std::string stream_chunk; // Scratch buffer for stream; kept to reuse its capacity
+	std::shared_ptr<StreamResumer> resumer; // Owning worker's resume queue
+	std::shared_ptr<StreamResumer::Stream> stream_token; // Identifies stream to its resume function
+	bool chunked = false; // Whether stream is sent using chunked transfer encoding
+	std::shared_ptr<const OpenFile> file; // File being sent, if any
+	uint64_t file_offset = 0; // Next byte of file to send
+	uint64_t file_end = 0; // End of the range of file being sent
+	SessionWait wait = SessionWait::READ;
+	std::chrono::steady_clock::time_point last_active = std::chrono::steady_clock::now();
+	std::list<HTTPSession>::iterator self; // Position within Worker::m_sessions, or Worker::m_free_sessions once closed
+	HTTPSession* timer_next = nullptr; // Link within Worker::m_timers
+	HTTPSession** timer_link = nullptr; // Pointer which links to this session within Worker::m_timers; nullptr if unscheduled
+
+	/**
+	* @brief Resets the session's state for reuse by another connection. Buffers keep their capacity, except for
+	* unusually large output buffers.
+	*/
+	void reset();
+
+	/**
+	* @brief Ends the streamed response body in progress, if any. Calls to its resume function are ignored from here on.
+	*/
+	void end_stream();
+
+	HTTPSession();
+	~HTTPSession();
+};
+
+HTTPSession::HTTPSession() {
+}
+
+HTTPSession::~HTTPSession() {
+	end_stream();
+}
+
+void HTTPSession::reset() {
+	parser.reset();
+	keep_alive = false;
+	closing = false;
+	version = HTTPVersion::HTTP_1_0;
+	if (output.capacity() > s_max_idle_output_capacity) {
+		std::string{}.swap(output);
+	}
+	else {
+		output.clear();
+	}
+	output_offset = 0;
+	output_accounted = 0;
+	end_stream();
+	if (stream_chunk.capacity() > s_max_idle_output_capacity) {
+		std::string{}.swap(stream_chunk);
+	}
+	else {
+		stream_chunk.clear();
+	}
+	chunked = false;
+	file = nullptr;
+	file_offset = 0;
+	file_end = 0;
+	wait = SessionWait::READ;
+	handshaking = false;
+}
+
+void HTTPSession::end_stream() {
+	stream = nullptr;
+	if (stream_token != nullptr) {
+		stream_token->session = nullptr;
+		stream_token = nullptr;
+	}
+}
+
+// Server::Data struct
+
+struct Jupiter::HTTP::Server::Data {
+	/** Event loop state; one runs on whichever thread calls think(), plus one per worker thread */
+	struct Worker;
+
+	/** Request for async content, processed on a handler thread and then handed back to its worker */
+	struct AsyncRequest {
+		AsyncRequest* next = nullptr; // Link within Worker::m_completed
+		Worker* worker;
+		HTTPSession* session;
+		HTTPRequest request; // Views over the session's socket buffer, which isn't read into while the session waits on a handler
+	};
+
+	/** Threads which process requests for async content */
+	struct HandlerPool {
+		Data& m_server;
+		std::vector<std::thread> m_threads; // Started with the first request
+		std::deque<AsyncRequest*> m_queue;
+		std::mutex m_mutex;
+		std::condition_variable m_condition;
+		bool m_running = true;
+
+		void post(AsyncRequest* in_request);
+		void run();
+
+		HandlerPool(Data& in_server);
+		~HandlerPool();
+	};
+
+	struct Worker {
+		Data& m_server;
+		std::vector<std::unique_ptr<Socket>> m_ports; // TODO: remove heap allocation, sockets are already pimpl
+		std::list<HTTPSession> m_sessions;
+		std::list<HTTPSession> m_free_sessions; // Closed sessions kept for reuse; most recently closed first
+		size_t m_free_low_water = 0; // Fewest free sessions since the pool was last trimmed
+		std::chrono::steady_clock::time_point m_next_trim = std::chrono::steady_clock::now();
+		TimerWheel<HTTPSession> m_timers; // Session timeouts
+#if defined JUPITER_HTTP_EPOLL
+		int m_epoll_fd = -1; // -1 when epoll is unavailable; think() falls back to polling every session
+		int m_wake_fd = -1; // eventfd used to interrupt epoll_wait(), and to signal completed requests to think()'s caller
+		std::vector<epoll_event> m_events = std::vector<epoll_event>(256);
+#endif // JUPITER_HTTP_EPOLL
+		std::atomic<bool> m_running{ false };
+		std::thread m_thread;
+		MPSCQueue<AsyncRequest> m_completed; // Async requests handed back by handler threads
+		std::atomic<size_t> m_async_pending{ 0 }; // Async requests not yet handed back
+		std::mutex m_pending_ports_mutex;
+		std::vector<std::unique_ptr<Socket>> m_pending_ports; // Listeners bound after the worker started; adopted by run()
+		std::shared_ptr<StreamResumer> m_resumer = std::make_shared<StreamResumer>(); // Streams to resume after their producers paused them
+
+		bool add_port(std::unique_ptr<Socket> in_port);
+		void post_port(std::unique_ptr<Socket> in_port);
+		void adopt_ports();
+		void accept_sessions(Socket& in_port);
+		bool handshake_session(HTTPSession& session);
+		bool read_session(HTTPSession& session);
+		bool service_session(HTTPSession& session);
+		bool write_session(HTTPSession& session);
+		void account_output(HTTPSession& session);
+		bool output_limit_exceeded() const;
+		void watch_session(HTTPSession& session, SessionWait in_wait);
+		void pause_session(HTTPSession& session);
+		bool resume_session(HTTPSession& session);
+		void resume_streams();
+		void finish_request(HTTPSession& session);
+		void complete_requests();
+		void destroy_session(HTTPSession& session);
+		void trim_sessions();
+		std::chrono::steady_clock::time_point session_deadline(const HTTPSession& session) const;
+		void expire_sessions();
+		int poll_timeout() const;
+		void poll_sessions();
+#if defined JUPITER_HTTP_EPOLL
+		void poll_events(int timeout_ms);
+#endif // JUPITER_HTTP_EPOLL
+		void run();
+		void wake();
+
+		Worker(Data& in_server);
+		Worker(const Worker&) = delete;
+		~Worker();
+	};
+
+	struct Binding {
+		std::string hostname;
+		uint16_t port;
+		bool secure;
+		std::string certificate;
+		std::string key;
+	};
+
+	/** Data */
+	std::vector<std::unique_ptr<Jupiter::HTTP::Server::Host>> m_hosts; // TODO: remove heap allocation, requires move semantics
+	std::unordered_map<std::string, HostRoutes, jessilib::text_hashi, jessilib::text_equali> m_routes; // Index over m_hosts; rebuilt by remove()
+	std::shared_mutex m_hosts_mutex; // Shared by request processing; exclusive for hook()/remove()
+	std::atomic<size_t> handler_thread_count{ 4 }; // Read when the handler threads start
+	HandlerPool m_handlers{ *this }; // Must outlive the workers, which wait on their async requests
+	Worker m_local_worker{ *this }; // Driven by think()
+	std::vector<std::unique_ptr<Worker>> m_workers; // Each drives itself on its own thread
+	std::vector<Binding> m_bindings;
+	std::atomic<std::chrono::milliseconds> session_timeout{ std::chrono::milliseconds(2000) };
+	std::atomic<std::chrono::milliseconds> keep_alive_session_timeout{ std::chrono::milliseconds(5000) };
+	std::atomic<std::chrono::milliseconds> stream_timeout{ std::chrono::milliseconds(30000) };
+	std::atomic<std::chrono::milliseconds> stream_retry_interval{ std::chrono::milliseconds(100) }; // For producers which don't resume their stream
+	bool kernel_tls = false; // Applied to tls_bind() listeners bound afterwards
+	std::string certificate; // Presented by tls_bind() listeners bound without a certificate of their own
+	std::string key;
+	Jupiter::Socket::Options socket_options; // Applied to listeners; accepted sessions inherit them
+	std::chrono::milliseconds session_pool_trim_interval = std::chrono::milliseconds(10000); // How often unused pooled sessions are freed
+	std::atomic<size_t> max_free_sessions{ 1024 }; // Upper bound on closed sessions pooled per worker
+	size_t max_request_size = 8192; // TODO: Config variable
+	std::atomic<size_t> max_buffered_output{ 64 * 1024 * 1024 }; // Unsent output across all sessions beyond which no new output is started
+	std::atomic<size_t> m_buffered_output{ 0 }; // Unsent output across all sessions, on all workers
+	bool permit_keept_alive = true; // TODO: Config variable
+
+	/** Foward functions */
+	void hook(std::string_view host, std::string_view path, std::unique_ptr<Content> in_content);
+	bool remove(std::string_view hostname);
+	//bool remove(std::string_view hostname, std::string_view path);
+	bool remove(std::string_view hostname, std::string_view path, std::string_view name);
+	bool has(std::string_view hostname);
+	bool has(std::string_view hostname, std::string_view name);
+	Jupiter::HTTP::Server::Host *find_host(std::string_view name);
+	Content* find(std::string_view name);
+	Content* find(std::string_view hostname, std::string_view name);
+	std::string* execute(std::string_view name, std::string_view query_string);
+	std::string* execute(std::string_view hostname, std::string_view name, std::string_view query_string);
+
+	bool process_request(HTTPSession& session, const HTTPRequest& request, bool in_allow_async = true);
+	void process_file_request(HTTPSession& session, const HTTPRequest& request, FileContent& in_content, std::string_view in_file_path);
+	void send_bad_request(HTTPSession& session);
+	void send_not_found(HTTPSession& session);
+	void send_response(HTTPSession& session, std::span<const std::string_view> in_buffers);
+
+	/** Route index */
+	HostRoutes* find_routes(std::string_view hostname);
+	Content* find_route(HostRoutes& routes, std::string_view path);
+	FileContent* find_mount(HostRoutes& routes, std::string_view path, std::string_view& out_file_path);
+	void index_content(HostRoutes& routes, std::string_view path, Content* in_content);
+	void index_directory(HostRoutes& routes, std::string& path, Directory& in_directory);
+	void rebuild_routes();
+
+	/** Listener & worker management */
+	std::unique_ptr<Socket> make_listener(const Binding& in_binding);
+	bool bind(Worker& in_worker, const Binding& in_binding);
+	bool add_binding(Binding in_binding);
+	bool start(size_t in_worker_count);
+	void stop();
+
+	/** Constructors */
+	Data();
+	Data(const Data &source) = delete;
+	Data(Data &&source) = delete;
+
+	/** Destructor */
+	~Data();
+};
+
+// Data constructor
+
+Jupiter::HTTP::Server::Data::Data() {
+	// hosts[0] is always the "global" namespace.
+	m_hosts.push_back(std::make_unique<Host>(""s));
+	rebuild_routes();
+}
+
+// Data destructor
+
+Jupiter::HTTP::Server::Data::~Data() {
+	// Workers must be joined before the hosts they reference go away
+	m_workers.clear();
+}
+
+// Worker constructor
+
+Jupiter::HTTP::Server::Data::Worker::Worker(Data& in_server)
+	: m_server{ in_server } {
+	m_resumer->wake = [this]() {
+		wake();
+	};
+
+#if defined JUPITER_HTTP_EPOLL
+	m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (m_epoll_fd < 0) {
+		return;
+	}
+
+	// The local worker is woken too, so that completed requests make the epoll descriptor readable (see getDescriptor())
+	m_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (m_wake_fd >= 0) {
+		epoll_event event{};
+		event.events = EPOLLIN;
+		event.data.ptr = this;
+		epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_wake_fd, &event);
+	}
+#endif // JUPITER_HTTP_EPOLL
+}
+
+// Worker destructor
+
+Jupiter::HTTP::Server::Data::Worker::~Worker() {
+	// Resume functions may outlive the worker
+	{
+		std::lock_guard guard{ m_resumer->mutex };
+		m_resumer->wake = nullptr;
+	}
+
+	if (m_thread.joinable()) {
+		m_running = false;
+		wake();
+		m_thread.join();
+	}
+
+	// Sessions waiting on handler threads are still referenced by them
+	while (m_async_pending != 0) {
+		std::this_thread::yield();
+	}
+
+	for (AsyncRequest* request = m_completed.pop_all(); request != nullptr;) {
+		std::unique_ptr<AsyncRequest> completed{ request };
+		request = request->next;
+	}
+
+	// Sessions & ports must close before the epoll instance goes away
+	for (auto& session : m_sessions) {
+		m_server.m_buffered_output -= session.output_accounted;
+	}
+	m_sessions.clear();
+	m_free_sessions.clear();
+	m_ports.clear();
+
+#if defined JUPITER_HTTP_EPOLL
+	if (m_wake_fd >= 0) {
+		::close(m_wake_fd);
+	}
+
+	if (m_epoll_fd >= 0) {
+		::close(m_epoll_fd);
+	}
+#endif // JUPITER_HTTP_EPOLL
+}
+
+// Data functions
+
+void Jupiter::HTTP::Server::Data::hook(std::string_view hostname, std::string_view in_path, std::unique_ptr<Content> in_content) {
+	Jupiter::HTTP::Server::Host* host = find_host(hostname);
+
+	if (host == nullptr) {
+		host = m_hosts.emplace_back(std::make_unique<Host>(static_cast<std::string>(hostname))).get();
+		m_routes.emplace(host->name, HostRoutes{ host, {}, {} });
+	}
+
+	in_content->update_headers();
+	auto routes = m_routes.find(JUPITER_WRAP_MAP_KEY(host->name));
+	index_content(routes->second, in_path, in_content.get());
+	host->hook(in_path, std::move(in_content));
+}
+
+bool Jupiter::HTTP::Server::Data::remove(std::string_view hostname) {
+	for (auto host_itr = m_hosts.begin(); host_itr != m_hosts.end(); ++host_itr) {
+		if (jessilib::equalsi((*host_itr)->name, hostname)) {
+			m_hosts.erase(host_itr);
+			rebuild_routes();
+			return true;
+		}
+	}
+	return false;
+}
+
+// name: path/to/resource OR path/
+bool Jupiter::HTTP::Server::Data::remove(std::string_view hostname, std::string_view path, std::string_view name) {
+	Jupiter::HTTP::Server::Host *host = find_host(hostname);
+	if (host == nullptr || !host->remove(path, name)) {
+		return false;
+	}
+
+	rebuild_routes();
+	return true;
+}
+
+bool Jupiter::HTTP::Server::Data::has(std::string_view hostname) {
+	return find_routes(hostname) != nullptr;
+}
+
+bool Jupiter::HTTP::Server::Data::has(std::string_view hostname, std::string_view name) {
+	HostRoutes* routes = find_routes(hostname);
+	return routes != nullptr && find_route(*routes, name) != nullptr;
+}
+
+Jupiter::HTTP::Server::Host *Jupiter::HTTP::Server::Data::find_host(std::string_view name) {
+	HostRoutes* routes = find_routes(name);
+	if (routes == nullptr) {
+		return nullptr;
+	}
+
+	return routes->host;
+}
+
+Jupiter::HTTP::Server::Content *Jupiter::HTTP::Server::Data::find(std::string_view name) {
+	return find(""sv, name);
+}
+
+Jupiter::HTTP::Server::Content *Jupiter::HTTP::Server::Data::find(std::string_view hostname, std::string_view name) {
+	HostRoutes* routes = find_routes(hostname);
+	if (routes == nullptr)
+		return nullptr;
+
+	return find_route(*routes, name);
+}
+
+std::string* Jupiter::HTTP::Server::Data::execute(std::string_view name, std::string_view query_string) {
+	Jupiter::HTTP::Server::Content *content = find(name);
+	if (content == nullptr)
+		return nullptr;
+
+	return content->execute(query_string);
+}
+
+std::string* Jupiter::HTTP::Server::Data::execute(std::string_view hostname, std::string_view name, std::string_view query_string) {
+	Jupiter::HTTP::Server::Content *content = find(hostname, name);
+	if (content == nullptr)
+		return nullptr;
+
+	return content->execute(query_string);
+}
+
+// Route index functions
+
+HostRoutes* Jupiter::HTTP::Server::Data::find_routes(std::string_view hostname) {
+	auto itr = m_routes.find(JUPITER_WRAP_MAP_KEY(hostname));
+	if (itr != m_routes.end()) {
+		return &itr->second;
+	}
+
+	// Host header may include a port; i.e: "localhost:8080" or "[::1]:8080"
+	size_t port_start = hostname.rfind(':');
+	if (port_start != std::string_view::npos && hostname.find(']', port_start) == std::string_view::npos) {
+		itr = m_routes.find(JUPITER_WRAP_MAP_KEY(hostname.substr(0, port_start)));
+		if (itr != m_routes.end()) {
+			return &itr->second;
+		}
+	}
+
+	return nullptr;
+}
+
+// Strips leading '/' and collapses repeated ones, matching the keys built by index_content(); Directory::find() skipped
+// empty segments too. Returns path itself when it's already normal, or out_buffer otherwise
+static std::string_view normalize_route(std::string_view path, std::string& out_buffer) {
+	while (!path.empty() && path.front() == '/') {
+		path.remove_prefix(1);
+	}
+
+	if (path.find("//"sv) == std::string_view::npos) {
+		return path;
+	}
+
+	out_buffer.clear();
+	out_buffer.reserve(path.size());
+	for (char token : path) {
+		if (token != '/' || out_buffer.back() != '/') {
+			out_buffer += token;
+		}
+	}
+
+	return out_buffer;
+}
+
+Jupiter::HTTP::Server::Content* Jupiter::HTTP::Server::Data::find_route(HostRoutes& routes, std::string_view path) {
+	std::string buffer;
+	path = normalize_route(path, buffer);
+
+	auto itr = routes.content.find(JUPITER_WRAP_MAP_KEY(path));
+	if (itr == routes.content.end()) {
+		return nullptr;
+	}
+
+	return itr->second;
+}
+
+// path must already be normalized by normalize_route(); out_file_path is set to a view over it
+Jupiter::HTTP::Server::FileContent* Jupiter::HTTP::Server::Data::find_mount(HostRoutes& routes, std::string_view path, std::string_view& out_file_path) {
+	if (routes.mounts.empty()) {
+		return nullptr;
+	}
+
+	// Deepest mount wins
+	size_t prefix_end = path.rfind('/');
+	while (prefix_end != std::string_view::npos) {
+		auto itr = routes.mounts.find(JUPITER_WRAP_MAP_KEY(path.substr(0, prefix_end)));
+		if (itr != routes.mounts.end()) {
+			out_file_path = path.substr(prefix_end + 1);
+			return itr->second;
+		}
+
+		if (prefix_end == 0) {
+			break;
+		}
+		prefix_end = path.rfind('/', prefix_end - 1);
+	}
+
+	// Mounted at the root of the host
+	auto itr = routes.mounts.find(JUPITER_WRAP_MAP_KEY(""sv));
+	if (itr != routes.mounts.end()) {
+		out_file_path = path;
+		return itr->second;
+	}
+
+	return nullptr;
+}
+
+void Jupiter::HTTP::Server::Data::index_content(HostRoutes& routes, std::string_view path, Content* in_content) {
+	std::string full_path;
+	full_path.reserve(path.size() + in_content->name.size() + 1);
+	while (true) {
+		size_t segment_start = path.find_first_not_of('/');
+		if (segment_start == std::string_view::npos) {
+			break;
+		}
+		path.remove_prefix(segment_start);
+
+		std::string_view segment = path.substr(size_t{ 0 }, path.find('/'));
+		path.remove_prefix(segment.size());
+		full_path += segment;
+		full_path += '/';
+	}
+	full_path += in_content->name;
+
+	auto file_content = dynamic_cast<FileContent*>(in_content);
+	if (file_content != nullptr && file_content->mount) {
+		routes.mounts.emplace(full_path, file_content);
+	}
+
+	// emplace() won't replace existing routes; the first Content hooked on a path takes precedence, as with Directory::find()
+	routes.content.emplace(std::move(full_path), in_content);
+}
+
+void Jupiter::HTTP::Server::Data::index_directory(HostRoutes& routes, std::string& path, Directory& in_directory) {
+	for (auto& content : in_directory.content) {
+		index_content(routes, path, content.get());
+	}
+
+	for (auto& directory : in_directory.directories) {
+		size_t path_size = path.size();
+		path += '/';
+		path += directory->name;
+		index_directory(routes, path, *directory);
+		path.resize(path_size);
+	}
+}
+
+void Jupiter::HTTP::Server::Data::rebuild_routes() {
+	m_routes.clear();
+
+	std::string path;
+	for (auto& host : m_hosts) {
+		auto result = m_routes.emplace(host->name, HostRoutes{ host.get(), {}, {} });
+		if (result.second) {
+			index_directory(result.first->second, path, *host);
+		}
+	}
+}
+
+// Returns false if the request is for async content, and in_allow_async is set; it must then be processed by a handler thread
+bool Jupiter::HTTP::Server::Data::process_request(HTTPSession& session, const HTTPRequest& request, bool in_allow_async) {
+	session.version = request.version;
+	session.keep_alive = request.keep_alive && permit_keept_alive;
+
+	Content* content = nullptr;
+	std::string_view file_path; // Path beneath a mounted FileContent
+	HostRoutes* routes = request.host.empty() ? nullptr : find_routes(request.host);
+	if (routes == nullptr) {
+		routes = find_routes(""sv);
+	}
+
+	std::string path_buffer; // Only used for paths with empty segments
+	if (routes != nullptr) {
+		std::string_view path = normalize_route(request.path, path_buffer);
+		content = find_route(*routes, path);
+		if (content == nullptr) {
+			content = find_mount(*routes, path, file_path);
+		}
+	}
+	auto file_content = dynamic_cast<FileContent*>(content);
+
+	size_t version = version_index(session.version);
+	switch (request.command)
+	{
+	case HTTPCommand::GET:
+	case HTTPCommand::HEAD:
+		if (file_content != nullptr)
+		{
+			process_file_request(session, request, *file_content, file_path);
+		}
+		else if (content != nullptr && content->async && in_allow_async)
+		{
+			return false;
+		}
+		else if (content != nullptr && content->is_streamed())
+		{
+			// 200 (success); the body is produced by the worker as the socket accepts it
+			session.chunked = session.version == HTTPVersion::HTTP_1_1;
+			if (!session.chunked && request.command == HTTPCommand::GET) {
+				// No Content-Length; the end of the body is the end of the connection
+				session.keep_alive = false;
+			}
+
+			std::string_view buffers[]{
+				s_ok_status_block[version],
+				s_date_cache.get(),
+				s_connection_block[session.keep_alive],
+				content->headers,
+				session.chunked ? s_chunked_block : s_end_of_headers
+			};
+			for (std::string_view buffer : buffers) {
+				session.output += buffer;
+			}
+
+			if (request.command == HTTPCommand::GET) {
+				session.stream_token = std::make_shared<StreamResumer::Stream>(&session);
+				session.stream = content->stream(request.query_string, [resumer = session.resumer, stream = session.stream_token]() {
+					resumer->resume(stream);
+				});
+				if (!session.stream && session.chunked) { // Nothing to produce; empty body
+					session.output += s_last_chunk;
+				}
+			}
+		}
+		else if (content != nullptr)
+		{
+			// TODO: remove referencestring warpper
+			std::string* content_result = nullptr;
+			std::shared_ptr<const Content::Cache::Response> cached_response;
+			std::string_view body;
+			std::string_view etag_header;
+			if (content->cache != nullptr) {
+				cached_response = content->cache->find(request.query_string);
+				if (cached_response == nullptr) {
+					content_result = content->execute(request.query_string);
+					if (content->free_result) {
+						cached_response = content->cache->insert(request.query_string, std::move(*content_result));
+						delete content_result;
 					}
 					else {
-						result += content->type;
+						cached_response = content->cache->insert(request.query_string, *content_result);
 					}
+					content_result = nullptr;
+				}
 
-					if (!content->charset.empty()) {
-						result += "; charset="sv;
-						result += content->charset;
-					}
-					result += HTTP_ENDL;
+				if (!request.if_none_match.empty() && etag_matches(request.if_none_match, cached_response->etag)) {
+					// 304 (not modified)
+					std::string_view buffers[]{
+						s_not_modified_status_block[version],
+						s_date_cache.get(),
+						s_connection_block[session.keep_alive],
+						cached_response->etag_header,
+						s_end_of_headers
+					};
+					send_response(session, buffers);
+					break;
+				}
 
-					if (!content->language.empty()) {
-						result += "Content-Language: "sv;
-						result += content->language;
-						result += HTTP_ENDL;
-					}
+				body = cached_response->body;
+				etag_header = cached_response->etag_header;
+			}
+			else {
+				content_result = content->execute(request.query_string);
+				body = *content_result;
+			}
 
-					result += HTTP_ENDL;
-					if (command == HTTPCommand::GET)
-						result += *content_result;
+			// 200 (success)
+			// Content-Length is the only header which needs formatting
+			char length_block[64] = "Content-Length: ";
+			char* length_end = std::to_chars(length_block + 16, length_block + sizeof(length_block) - 4, body.size()).ptr;
+			std::memcpy(length_end, HTTP_ENDL HTTP_ENDL, 4);
+
+			std::string_view buffers[]{
+				s_ok_status_block[version],
+				s_date_cache.get(),
+				s_connection_block[session.keep_alive],
+				content->headers,
+				etag_header,
+				{ length_block, static_cast<size_t>(length_end - length_block) + 4 },
+				body
+			};
+
+			if (request.command == HTTPCommand::GET) {
+				send_response(session, buffers);
+			}
+			else {
+				send_response(session, std::span{ buffers }.first(std::size(buffers) - 1));
+			}
 
-					if (content->free_result)
-						delete content_result;
+			if (content->free_result)
+				delete content_result;
+		}
+		else
+		{
+			send_not_found(session);
+		}
+		break;
+	default:
+		break;
+	}
 
-					session.sock.send(result);
-				}
-				else
-				{
-					// 404 (not found)
-
-					switch (session.version)
-					{
-					default:
-					case HTTPVersion::HTTP_1_0:
-						result = "HTTP/1.0 404 Not Found"sv HTTP_ENDL;
-						break;
-					case HTTPVersion::HTTP_1_1:
-						result = "HTTP/1.1 404 Not Found"sv HTTP_ENDL;
-						break;
-					}
+	return true;
+}
+
+void Jupiter::HTTP::Server::Data::process_file_request(HTTPSession& session, const HTTPRequest& request, FileContent& in_content, std::string_view in_file_path) {
+	std::shared_ptr<const OpenFile> file = in_content.files->open(in_content, in_file_path);
+	if (file == nullptr) {
+		send_not_found(session);
+		return;
+	}
+
+	// Responses are queued rather than sent, so that the file body is sent after the headers; see Worker::write_session()
+	size_t version = version_index(session.version);
+	if (!request.if_modified_since.empty() && request.if_modified_since == file->last_modified) {
+		// 304 (not modified); like most servers, this only compares against the exact Last-Modified value sent
+		std::string_view buffers[]{
+			s_not_modified_status_block[version],
+			s_date_cache.get(),
+			s_connection_block[session.keep_alive],
+			s_end_of_headers
+		};
+		for (std::string_view buffer : buffers) {
+			session.output += buffer;
+		}
+		return;
+	}
+
+	uint64_t begin = 0;
+	uint64_t end = file->size;
+	RangeState range_state = request.range.empty() ? RangeState::NONE : parse_range(request.range, file->size, begin, end);
+	char range_block[96];
+	size_t range_block_size = 0;
+	if (range_state == RangeState::UNSATISFIABLE) {
+		// 416 (range not satisfiable)
+		char* range_end = std::to_chars(range_block, range_block + sizeof(range_block), file->size).ptr;
+		std::string_view buffers[]{
+			s_range_not_satisfiable_block[version][session.keep_alive],
+			s_date_cache.get(),
+			"Content-Range: bytes */"sv,
+			{ range_block, static_cast<size_t>(range_end - range_block) },
+			HTTP_ENDL HTTP_ENDL ""sv
+		};
+		for (std::string_view buffer : buffers) {
+			session.output += buffer;
+		}
+		return;
+	}
+
+	if (range_state == RangeState::VALID) {
+		// 206 (partial content)
+		char* range_end = range_block;
+		std::memcpy(range_end, "Content-Range: bytes ", 21);
+		range_end = std::to_chars(range_end + 21, range_block + sizeof(range_block), begin).ptr;
+		*range_end++ = '-';
+		range_end = std::to_chars(range_end, range_block + sizeof(range_block), end - 1).ptr;
+		*range_end++ = '/';
+		range_end = std::to_chars(range_end, range_block + sizeof(range_block) - 2, file->size).ptr;
+		std::memcpy(range_end, HTTP_ENDL, 2);
+		range_block_size = static_cast<size_t>(range_end - range_block) + 2;
+	}
+
+	char length_block[64] = "Content-Length: ";
+	char* length_end = std::to_chars(length_block + 16, length_block + sizeof(length_block) - 4, end - begin).ptr;
+	std::memcpy(length_end, HTTP_ENDL HTTP_ENDL, 4);
+
+	std::string_view buffers[]{
+		range_state == RangeState::VALID ? s_partial_content_status_block[version] : s_ok_status_block[version],
+		s_date_cache.get(),
+		s_connection_block[session.keep_alive],
+		file->headers,
+		{ range_block, range_block_size },
+		{ length_block, static_cast<size_t>(length_end - length_block) + 4 }
+	};
+	for (std::string_view buffer : buffers) {
+		session.output += buffer;
+	}
+
+	if (request.command == HTTPCommand::GET && begin != end) {
+		session.file = std::move(file);
+		session.file_offset = begin;
+		session.file_end = end;
+	}
+}
+
+void Jupiter::HTTP::Server::Data::send_bad_request(HTTPSession& session) {
+	std::string_view buffers[]{
+		s_bad_request_block,
+		s_date_cache.get(),
+		s_end_of_headers
+	};
+	send_response(session, buffers);
+}
+
+void Jupiter::HTTP::Server::Data::send_not_found(HTTPSession& session) {
+	// 404 (not found)
+	std::string_view buffers[]{
+		s_not_found_block[version_index(session.version)][session.keep_alive],
+		s_date_cache.get(),
+		s_end_of_headers
+	};
+	send_response(session, buffers);
+}
+
+void Jupiter::HTTP::Server::Data::send_response(HTTPSession& session, std::span<const std::string_view> in_buffers) {
+	// Send directly when nothing is queued ahead of this response; whatever the socket doesn't accept is queued, and
+	// sent by Worker::write_session() once the socket is writable. Errors also surface there.
+	size_t sent = 0;
+	if (session.output_offset == session.output.size()) {
+		int result = session.sock->sendv(in_buffers);
+		if (result > 0) {
+			sent = static_cast<size_t>(result);
+			session.last_active = std::chrono::steady_clock::now();
+		}
+	}
+
+	for (std::string_view buffer : in_buffers) {
+		if (sent >= buffer.size()) {
+			sent -= buffer.size();
+			continue;
+		}
+
+		session.output.append(buffer.substr(sent));
+		sent = 0;
+	}
+}
+
+/** HTTP::Server */
+
+// Server constructors
+
+Jupiter::HTTP::Server::Server() {
+	m_data = new Data();
+}
+
+Jupiter::HTTP::Server::Server(Jupiter::HTTP::Server &&source) {
+	m_data = source.m_data;
+	source.m_data = new Data();
+}
+
+Jupiter::HTTP::Server::~Server() {
+	delete m_data;
+}
+
+// Server functions
+
+void Jupiter::HTTP::Server::hook(std::string_view host, std::string_view name, std::unique_ptr<Content> content) {
+	std::unique_lock lock{ m_data->m_hosts_mutex };
+	return m_data->hook(host, name, std::move(content));
+}
+
+bool Jupiter::HTTP::Server::remove(std::string_view host) {
+	std::unique_lock lock{ m_data->m_hosts_mutex };
+	return m_data->remove(host);
+}
+
+bool Jupiter::HTTP::Server::remove(std::string_view host, std::string_view path, std::string_view name) {
+	std::unique_lock lock{ m_data->m_hosts_mutex };
+	return m_data->remove(host, path, name);
+}
+
+bool Jupiter::HTTP::Server::has(std::string_view host) {
+	std::shared_lock lock{ m_data->m_hosts_mutex };
+	return m_data->has(host);
+}
+
+bool Jupiter::HTTP::Server::has(std::string_view host, std::string_view name) {
+	std::shared_lock lock{ m_data->m_hosts_mutex };
+	return m_data->has(host, name);
+}
+
+Jupiter::HTTP::Server::Content *Jupiter::HTTP::Server::find(std::string_view name) {
+	std::shared_lock lock{ m_data->m_hosts_mutex };
+	return m_data->find(name);
+}
+
+Jupiter::HTTP::Server::Content *Jupiter::HTTP::Server::find(std::string_view host, std::string_view name) {
+	std::shared_lock lock{ m_data->m_hosts_mutex };
+	return m_data->find(host, name);
+}
+
+std::string* Jupiter::HTTP::Server::execute(std::string_view name, std::string_view query_string) {
+	std::shared_lock lock{ m_data->m_hosts_mutex };
+	return m_data->execute(name, query_string);
+}
+
+std::string* Jupiter::HTTP::Server::execute(std::string_view host, std::string_view name, std::string_view query_string) {
+	std::shared_lock lock{ m_data->m_hosts_mutex };
+	return m_data->execute(host, name, query_string);
+}
+
+bool Jupiter::HTTP::Server::bind(std::string_view hostname, uint16_t port) {
+	return m_data->add_binding({ static_cast<std::string>(hostname), port, false, {}, {} });
+}
+
+bool Jupiter::HTTP::Server::tls_bind(std::string_view hostname, uint16_t port, std::string_view certificate, std::string_view key) {
+	if (key.empty()) {
+		key = certificate;
+	}
+
+	return m_data->add_binding({ static_cast<std::string>(hostname), port, true, static_cast<std::string>(certificate), static_cast<std::string>(key) });
+}
+
+bool Jupiter::HTTP::Server::tls_bind(std::string_view hostname, uint16_t port) {
+	if (m_data->certificate.empty()) {
+		return false;
+	}
+
+	return m_data->add_binding({ static_cast<std::string>(hostname), port, true, m_data->certificate, m_data->key });
+}
+
+bool Jupiter::HTTP::Server::start(size_t in_worker_count) {
+	return m_data->start(in_worker_count);
+}
+
+void Jupiter::HTTP::Server::stop() {
+	m_data->stop();
+}
+
+size_t Jupiter::HTTP::Server::getWorkerCount() const {
+	return m_data->m_workers.size();
+}
+
+void Jupiter::HTTP::Server::setSessionTimeout(std::chrono::milliseconds in_timeout) {
+	m_data->session_timeout = in_timeout;
+}
+
+std::chrono::milliseconds Jupiter::HTTP::Server::getSessionTimeout() const {
+	return m_data->session_timeout;
+}
+
+void Jupiter::HTTP::Server::setKeepAliveSessionTimeout(std::chrono::milliseconds in_timeout) {
+	m_data->keep_alive_session_timeout = in_timeout;
+}
+
+std::chrono::milliseconds Jupiter::HTTP::Server::getKeepAliveSessionTimeout() const {
+	return m_data->keep_alive_session_timeout;
+}
+
+void Jupiter::HTTP::Server::setStreamTimeout(std::chrono::milliseconds in_timeout) {
+	m_data->stream_timeout = in_timeout;
+}
+
+std::chrono::milliseconds Jupiter::HTTP::Server::getStreamTimeout() const {
+	return m_data->stream_timeout;
+}
+
+void Jupiter::HTTP::Server::setStreamRetryInterval(std::chrono::milliseconds in_interval) {
+	m_data->stream_retry_interval = in_interval;
+}
+
+std::chrono::milliseconds Jupiter::HTTP::Server::getStreamRetryInterval() const {
+	return m_data->stream_retry_interval;
+}
+
+void Jupiter::HTTP::Server::setMaxBufferedOutput(size_t in_max_size) {
+	m_data->max_buffered_output = in_max_size;
+}
+
+size_t Jupiter::HTTP::Server::getMaxBufferedOutput() const {
+	return m_data->max_buffered_output;
+}
+
+void Jupiter::HTTP::Server::setHandlerThreadCount(size_t in_thread_count) {
+	m_data->handler_thread_count = in_thread_count;
+}
+
+size_t Jupiter::HTTP::Server::getHandlerThreadCount() const {
+	return m_data->handler_thread_count;
+}
+
+void Jupiter::HTTP::Server::setMaxFreeSessions(size_t in_max_sessions) {
+	m_data->max_free_sessions = in_max_sessions;
+}
+
+size_t Jupiter::HTTP::Server::getMaxFreeSessions() const {
+	return m_data->max_free_sessions;
+}
+
+void Jupiter::HTTP::Server::setCertificate(std::string_view certificate, std::string_view key) {
+	m_data->certificate = certificate;
+	m_data->key = key.empty() ? certificate : key;
+}
+
+void Jupiter::HTTP::Server::setKernelTLS(bool in_enabled) {
+	m_data->kernel_tls = in_enabled;
+}
+
+bool Jupiter::HTTP::Server::getKernelTLS() const {
+	return m_data->kernel_tls;
+}
+
+void Jupiter::HTTP::Server::setSocketOptions(const Jupiter::Socket::Options& in_options) {
+	m_data->socket_options = in_options;
+}
+
+void Jupiter::HTTP::Server::setSocketOptions(const Jupiter::Config& in_config) {
+	m_data->socket_options = Jupiter::Socket::Options::read([&in_config](std::string_view key) {
+		return in_config.get(key);
+	});
+}
+
+const Jupiter::Socket::Options& Jupiter::HTTP::Server::getSocketOptions() const {
+	return m_data->socket_options;
+}
+
+// Listener & worker management
+
+std::unique_ptr<Jupiter::Socket> Jupiter::HTTP::Server::Data::make_listener(const Binding& in_binding) {
+	std::unique_ptr<Socket> socket;
+	if (in_binding.secure) {
+		auto secure_socket = std::make_unique<Jupiter::SecureTCPSocket>();
+		secure_socket->setCertificate(in_binding.certificate, in_binding.key);
+		secure_socket->setKernelTLS(kernel_tls);
+		socket = std::move(secure_socket);
+	}
+	else {
+		socket = std::make_unique<Jupiter::TCPSocket>();
+	}
+
+	// Worker threads each listen on their own socket; the kernel balances connections between them
+	socket->setReusePort(!m_workers.empty());
+	socket->setOptions(socket_options);
+	if (!socket->bind(in_binding.hostname.c_str(), in_binding.port, true)) {
+		return nullptr;
+	}
+
+	socket->setBlocking(false);
+	return socket;
+}
+
+// Only for workers which aren't running; see add_binding()
+bool Jupiter::HTTP::Server::Data::bind(Worker& in_worker, const Binding& in_binding) {
+	std::unique_ptr<Socket> socket = make_listener(in_binding);
+	return socket != nullptr && in_worker.add_port(std::move(socket));
+}
+
+bool Jupiter::HTTP::Server::Data::add_binding(Binding in_binding) {
+	if (m_workers.empty()) {
+		if (!bind(m_local_worker, in_binding)) {
+			return false;
+		}
+	}
+	else {
+		// Every worker's listener is bound before any are handed over, so that a failure leaves none behind
+		std::vector<std::unique_ptr<Socket>> listeners;
+		for (size_t index = 0; index != m_workers.size(); ++index) {
+			std::unique_ptr<Socket> listener = make_listener(in_binding);
+			if (listener == nullptr) {
+				return false;
+			}
+
+			listeners.push_back(std::move(listener));
+		}
+
+		// Running workers adopt their listeners on their own threads
+		for (size_t index = 0; index != m_workers.size(); ++index) {
+			m_workers[index]->post_port(std::move(listeners[index]));
+		}
+	}
+
+	m_bindings.push_back(std::move(in_binding));
+	return true;
+}
+
+bool Jupiter::HTTP::Server::Data::start(size_t in_worker_count) {
+#if defined JUPITER_HTTP_EPOLL
+	if (!m_workers.empty() || in_worker_count == 0) {
+		return false;
+	}
+
+	for (size_t index = 0; index != in_worker_count; ++index) {
+		auto& worker = m_workers.emplace_back(std::make_unique<Worker>(*this));
+		if (worker->m_epoll_fd < 0 || worker->m_wake_fd < 0) {
+			m_workers.clear();
+			return false;
+		}
+	}
+
+	// Listeners move from think() to the workers; sessions already accepted are still serviced by think()
+	m_local_worker.m_ports.clear();
+	for (const auto& binding : m_bindings) {
+		for (auto& worker : m_workers) {
+			if (!bind(*worker, binding)) {
+				stop();
+				return false;
+			}
+		}
+	}
+
+	for (auto& worker : m_workers) {
+		worker->m_running = true;
+		worker->m_thread = std::thread(&Worker::run, worker.get());
+	}
+
+	return true;
+#else // JUPITER_HTTP_EPOLL
+	return false;
+#endif // JUPITER_HTTP_EPOLL
+}
+
+void Jupiter::HTTP::Server::Data::stop() {
+	if (m_workers.empty()) {
+		return;
+	}
+
+	// Workers shut down their own listeners & sessions when destroyed
+	m_workers.clear();
+	for (const auto& binding : m_bindings) {
+		bind(m_local_worker, binding);
+	}
+}
+
+// HandlerPool functions
+
+Jupiter::HTTP::Server::Data::HandlerPool::HandlerPool(Data& in_server)
+	: m_server{ in_server } {
+}
+
+Jupiter::HTTP::Server::Data::HandlerPool::~HandlerPool() {
+	{
+		std::lock_guard guard{ m_mutex };
+		m_running = false;
+	}
+	m_condition.notify_all();
+
+	for (auto& thread : m_threads) {
+		thread.join();
+	}
+}
+
+void Jupiter::HTTP::Server::Data::HandlerPool::post(AsyncRequest* in_request) {
+	{
+		std::lock_guard guard{ m_mutex };
+		if (m_threads.empty()) {
+			for (size_t index = 0; index < std::max<size_t>(m_server.handler_thread_count.load(), 1); ++index) {
+				m_threads.emplace_back(&HandlerPool::run, this);
+			}
+		}
+
+		m_queue.push_back(in_request);
+	}
+	m_condition.notify_one();
+}
+
+void Jupiter::HTTP::Server::Data::HandlerPool::run() {
+	while (true) {
+		AsyncRequest* request;
+		{
+			std::unique_lock lock{ m_mutex };
+			m_condition.wait(lock, [this] { return !m_queue.empty() || !m_running; });
+			if (m_queue.empty()) { // Shutting down
+				return;
+			}
+
+			request = m_queue.front();
+			m_queue.pop_front();
+		}
+
+		// Routes are resolved again, since hook()/remove() may have run since the request was posted
+		{
+			std::shared_lock lock{ m_server.m_hosts_mutex };
+			m_server.process_request(*request->session, request->request, false);
+		}
 
-					char *time_header = html_time();
-					result += "Date: "sv HTTP_ENDL;
-					result += time_header;
-					delete[] time_header;
+		// The worker may be destroyed as soon as m_async_pending reaches 0
+		Worker* worker = request->worker;
+		worker->m_completed.push(request);
+		worker->wake();
+		--worker->m_async_pending;
+	}
+}
 
-					result += "Server: "sv JUPITER_VERSION HTTP_ENDL;
+// Worker functions
 
-					result += "Content-Length: 0"sv HTTP_ENDL;
+bool Jupiter::HTTP::Server::Data::Worker::add_port(std::unique_ptr<Socket> in_port) {
+#if defined JUPITER_HTTP_EPOLL
+	if (m_epoll_fd >= 0) {
+		epoll_event event{};
+		event.events = EPOLLIN;
+		event.data.ptr = in_port.get();
+		if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, in_port->getDescriptor(), &event) != 0) {
+			return false;
+		}
+	}
+#endif // JUPITER_HTTP_EPOLL
 
-					if (session.keep_alive)
-						result += "Connection: keep-alive"sv HTTP_ENDL;
-					else
-						result += "Connection: close"sv HTTP_ENDL;
+	m_ports.push_back(std::move(in_port));
+	return true;
+}
 
-					result += HTTP_ENDL HTTP_ENDL;
-					session.sock.send(result);
-				}
-				break;
-			default:
-				break;
-			}
+void Jupiter::HTTP::Server::Data::Worker::post_port(std::unique_ptr<Socket> in_port) {
+	{
+		std::lock_guard guard{ m_pending_ports_mutex };
+		m_pending_ports.push_back(std::move(in_port));
+	}
+	wake();
+}
 
-			if (session.keep_alive == false) {// not keep-alive -- will be destroyed on return
-				break;
-			}
+void Jupiter::HTTP::Server::Data::Worker::adopt_ports() {
+	std::vector<std::unique_ptr<Socket>> ports;
+	{
+		std::lock_guard guard{ m_pending_ports_mutex };
+		ports.swap(m_pending_ports);
+	}
 
-			if (index == lines.size()) { // end of packet
-				session.request.erase();
-			}
-			else { // end of request -- another request is following
-				// Maybe there's still some value in a shifty string, to avoid substr calls & heap allocations...
-				session.request = session.request.substr(get_line_offset(index));
-			}
+	// A listener which can't be registered is closed, as there's no caller left to report to
+	for (auto& port : ports) {
+		add_port(std::move(port));
+	}
+}
 
-			if (session.request.find(HTTP_REQUEST_ENDING) != std::string::npos) { // there's another full request already received
-				return process_request(session);
-			}
-			break;
+void Jupiter::HTTP::Server::Data::Worker::accept_sessions(Socket& in_port) {
+	bool secure = dynamic_cast<SecureSocket*>(&in_port) != nullptr;
+
+	// Drain the backlog, rather than taking one connection per poll
+	while (true) {
+		// Reuse a pooled session where possible, along with its buffers
+		if (m_free_sessions.empty()) {
+			m_free_sessions.emplace_front();
+			m_free_sessions.front().self = m_free_sessions.begin();
+			m_free_sessions.front().resumer = m_resumer;
+			m_free_low_water = 0;
 		}
 
-		// Not empty
-		auto first_split = jessilib::split_once_view(line, ' ');
-		first_token = first_split.first;
-
-		if (first_token.back() == ':') { // header field
-			first_token.remove_suffix(1); // trim trailing ':'
-			if (jessilib::equalsi(first_token, "HOST"sv)) {
-				session.host = find_host(first_split.second);
+		HTTPSession& session = m_free_sessions.front();
+		if (session.sock == nullptr || secure != (session.tls != nullptr)) {
+			if (secure) {
+				auto secure_socket = std::make_unique<Jupiter::SecureTCPSocket>();
+				session.tls = secure_socket.get();
+				session.sock = std::move(secure_socket);
 			}
-			else if (jessilib::equalsi(first_token, "CONNECTION"sv)) {
-				std::string_view connection_type = first_split.second;
-				if (jessilib::equalsi(connection_type, "keep-alive"sv)) {
-					session.keep_alive = permit_keept_alive;
-				}
+			else {
+				session.tls = nullptr;
+				session.sock = std::make_unique<Jupiter::TCPSocket>();
 			}
+			session.sock->setRetainBuffer(true);
 		}
-		else { // command
-			if (first_token == "GET"sv) {
-				command = HTTPCommand::GET;
 
-				auto second_split = jessilib::split_once_view(first_split.second, ' ');
-				query_string = second_split.first;
-				span = query_string.find('?'); // repurposing 'span'
-				if (span == std::string_view::npos) {
-					if (session.host == nullptr) {
-						content = find(query_string);
-					}
-					else {
-						content = session.host->find(query_string);
-					}
-					query_string = std::string_view{};
-				}
-				else {
-					if (session.host == nullptr) {
-						content = find(query_string.substr(size_t{ 0 }, span));
-					}
-					else {
-						content = session.host->find(query_string.substr(size_t{ 0 }, span));
-					}
-					query_string.remove_prefix(span + 1);
-					// decode query_string here
-				}
+		if (!in_port.accept(*session.sock, false)) {
+			return;
+		}
 
-				std::string_view protocol_str = second_split.second;
-				if (jessilib::equalsi(protocol_str, "http/1.0"sv)) {
-					session.version = HTTPVersion::HTTP_1_0;
-				}
-				else if (jessilib::equalsi(protocol_str, "http/1.1"sv)) {
-					session.version = HTTPVersion::HTTP_1_1;
-					session.keep_alive = permit_keept_alive;
-				}
+		m_sessions.splice(m_sessions.end(), m_free_sessions, session.self);
+		m_free_low_water = std::min(m_free_low_water, m_free_sessions.size());
+		session.last_active = std::chrono::steady_clock::now();
+		m_timers.schedule(session, session_deadline(session));
+
+#if defined JUPITER_HTTP_EPOLL
+		if (m_epoll_fd >= 0) {
+			epoll_event event{};
+			event.events = EPOLLIN | EPOLLRDHUP;
+			event.data.ptr = &session;
+			if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, session.sock->getDescriptor(), &event) != 0) {
+				destroy_session(session);
+				continue;
 			}
-			else if (first_token == "HEAD"sv) {
-				command = HTTPCommand::HEAD;
-
-				auto second_split = jessilib::split_once_view(first_split.second, ' ');
-				query_string = second_split.first;
-				span = query_string.find('?'); // repurposing 'span'
-				if (span == std::string_view::npos) {
-					if (session.host == nullptr) {
-						content = find(query_string);
-					}
-					else {
-						content = session.host->find(query_string);
-					}
-					query_string = std::string_view{};
-				}
-				else {
-					if (session.host == nullptr) {
-						content = find(query_string.substr(size_t{ 0 }, span));
-					}
-					else {
-						content = session.host->find(query_string.substr(size_t{ 0 }, span));
-					}
-					query_string.remove_prefix(span + 1);
-					// decode query_string here
-				}
+		}
+#endif // JUPITER_HTTP_EPOLL
 
-				std::string_view protocol_str = second_split.second;
-				if (jessilib::equalsi(protocol_str, "http/1.0"sv)) {
-					session.version = HTTPVersion::HTTP_1_0;
-				}
-				else if (jessilib::equalsi(protocol_str, "http/1.1"sv)) {
-					session.version = HTTPVersion::HTTP_1_1;
-					session.keep_alive = permit_keept_alive;
-				}
-			}
-			else
-				command = HTTPCommand::UNKNOWN;
+		// Clients generally send their request (or TLS ClientHello) immediately; try to handle it without waiting on another poll
+		session.handshaking = secure;
+		if (!(session.handshaking ? handshake_session(session) : read_session(session))) {
+			destroy_session(session);
 		}
 	}
-	return 0;
 }
 
-/** HTTP::Server */
+// Drives a TLS session's handshake. Returns false if the session should be destroyed
+bool Jupiter::HTTP::Server::Data::Worker::handshake_session(HTTPSession& session) {
+	int result = session.tls->handshake();
+	if (result < 0) {
+		return false;
+	}
 
-// Server constructors
+	if (result == 0) {
+		watch_session(session, session.tls->getIOWait() == SecureSocket::IOWait::WRITE ? SessionWait::WRITE : SessionWait::READ);
+		return true;
+	}
 
-Jupiter::HTTP::Server::Server() {
-	m_data = new Data();
+	session.handshaking = false;
+	session.last_active = std::chrono::steady_clock::now();
+	watch_session(session, SessionWait::READ);
+	return read_session(session);
 }
 
-Jupiter::HTTP::Server::Server(Jupiter::HTTP::Server &&source) {
-	m_data = source.m_data;
-	source.m_data = new Data();
+// Returns false if the session should be destroyed
+bool Jupiter::HTTP::Server::Data::Worker::read_session(HTTPSession& session) {
+	if (session.sock->isShutdown()) {
+		// Discard whatever arrives until the peer closes
+		int result = session.sock->recv();
+		session.sock->clearBuffer();
+		return result != 0;
+	}
+
+	// Decrypted data left over from a TLS record doesn't make the socket readable again; read it all now
+	do {
+		int result = session.sock->recv();
+		if (result <= 0) {
+			// EWOULDBLOCK: session not deleted
+			return result < 0 && session.sock->getLastError() == JUPITER_SOCK_EWOULDBLOCK;
+		}
+
+		// Requests are parsed in place over the socket's buffer, which keeps any data not yet consumed
+		if (session.sock->getBuffer().size() > m_server.max_request_size) { // reject
+			return false;
+		}
+	} while (session.tls != nullptr && session.tls->getPending() != 0);
+
+	return service_session(session);
 }
 
-Jupiter::HTTP::Server::~Server() {
-	delete m_data;
+// Returns false if the session should be destroyed
+bool Jupiter::HTTP::Server::Data::Worker::service_session(HTTPSession& session) {
+	// Process every complete request received so far; pipelined requests are parsed in place
+	while (true) {
+		// Finish sending the current response before starting on the next one
+		if (!write_session(session)) {
+			return false;
+		}
+
+		account_output(session);
+		if (session.wait == SessionWait::PAUSED) { // Nothing is left to send meanwhile
+			return true;
+		}
+
+		if (session.stream || session.file != nullptr || session.output_offset != session.output.size()) {
+			watch_session(session, SessionWait::WRITE);
+			return true;
+		}
+
+		watch_session(session, SessionWait::READ);
+		if (session.closing) { // remove completed session
+			return false;
+		}
+
+		// Responses in flight are always sent; further requests wait until the server is back under its limit
+		if (output_limit_exceeded() && !session.sock->getBuffer().empty()) {
+			session.last_active = std::chrono::steady_clock::now(); // The request's arrival; see setStreamTimeout()
+			pause_session(session);
+			return true;
+		}
+
+		std::string_view request_view = session.sock->getBuffer();
+		auto state = session.parser.parse(request_view);
+		if (state == HTTPRequestParser::State::INCOMPLETE) {
+			// request not over: session not deleted
+			return true;
+		}
+
+		if (state == HTTPRequestParser::State::ERROR) { // reject
+			m_server.send_bad_request(session);
+			return false;
+		}
+
+		// completed request
+		session.last_active = std::chrono::steady_clock::now();
+		HTTPRequest request = session.parser.request(request_view);
+		bool processed;
+		{
+			std::shared_lock lock{ m_server.m_hosts_mutex };
+			processed = m_server.process_request(session, request);
+		}
+
+		if (!processed) {
+			// Async content; the session waits on a handler thread, which preserves the order of pipelined requests
+			watch_session(session, SessionWait::HANDLER);
+			++m_async_pending;
+			m_server.m_handlers.post(new AsyncRequest{ nullptr, this, &session, request });
+			return true;
+		}
+
+		finish_request(session);
+	}
 }
 
-// Server functions
+void Jupiter::HTTP::Server::Data::Worker::finish_request(HTTPSession& session) {
+	session.closing = !session.keep_alive;
+	session.sock->consumeBuffer(session.parser.size());
+	session.parser.reset();
+}
 
-void Jupiter::HTTP::Server::hook(std::string_view host, std::string_view name, std::unique_ptr<Content> content) {
-	return m_data->hook(host, name, std::move(content));
+void Jupiter::HTTP::Server::Data::Worker::complete_requests() {
+	for (AsyncRequest* request = m_completed.pop_all(); request != nullptr;) {
+		std::unique_ptr<AsyncRequest> completed{ request };
+		request = request->next;
+
+		HTTPSession& session = *completed->session;
+		finish_request(session);
+		watch_session(session, SessionWait::READ);
+		if (!service_session(session)) {
+			destroy_session(session);
+		}
+	}
 }
 
-bool Jupiter::HTTP::Server::remove(std::string_view host) {
-	return m_data->remove(host);
+// Sends pending output, followed by the session's file or stream while the socket keeps accepting it.
+// Returns false if the session should be destroyed
+bool Jupiter::HTTP::Server::Data::Worker::write_session(HTTPSession& session) {
+	size_t produced = 0;
+	while (true) {
+		while (session.output_offset != session.output.size()) {
+			int result = session.sock->send(session.output.data() + session.output_offset, session.output.size() - session.output_offset);
+			if (result <= 0) {
+				// EWOULDBLOCK: wait for the socket to become writable
+				return result < 0 && session.sock->getLastError() == JUPITER_SOCK_EWOULDBLOCK;
+			}
+
+			session.output_offset += result;
+			session.last_active = std::chrono::steady_clock::now();
+		}
+
+		if (session.output.capacity() > s_max_idle_output_capacity) {
+			std::string{}.swap(session.output);
+		}
+		else {
+			session.output.clear();
+		}
+		session.output_offset = 0;
+
+		if (session.file != nullptr) {
+			if (session.file_offset == session.file_end) {
+				session.file = nullptr;
+				continue;
+			}
+
+			if (produced >= s_max_stream_burst) {
+				return true;
+			}
+
+			size_t count = static_cast<size_t>(std::min<uint64_t>(session.file_end - session.file_offset, s_max_stream_burst));
+			int result = session.sock->sendFile(session.file->fd, session.file_offset, count);
+			if (result <= 0) {
+				// EWOULDBLOCK: wait for the socket to become writable
+				return result < 0 && session.sock->getLastError() == JUPITER_SOCK_EWOULDBLOCK;
+			}
+
+			session.file_offset += result;
+			produced += result;
+			session.last_active = std::chrono::steady_clock::now();
+			continue;
+		}
+
+		if (!session.stream || produced >= s_max_stream_burst) {
+			return true;
+		}
+
+		// As with requests, hold off producing more while the server is over its limit on buffered output
+		account_output(session);
+		if (output_limit_exceeded()) {
+			pause_session(session);
+			return true;
+		}
+
+		session.stream_chunk.clear();
+		bool more = session.stream(session.stream_chunk);
+		produced += session.stream_chunk.size();
+
+		if (session.chunked && !session.stream_chunk.empty()) {
+			char size_line[24];
+			char* size_end = std::to_chars(size_line, size_line + sizeof(size_line) - 2, session.stream_chunk.size(), 16).ptr;
+			std::memcpy(size_end, HTTP_ENDL, 2);
+			session.output.append(size_line, size_end + 2);
+			session.output += session.stream_chunk;
+			session.output += HTTP_ENDL ""sv;
+		}
+		else {
+			session.output += session.stream_chunk;
+		}
+
+		if (!more) {
+			session.end_stream();
+			if (session.chunked) {
+				session.output += s_last_chunk;
+			}
+		}
+		else if (session.stream_chunk.empty()) {
+			// Producer has nothing ready; writable sockets would just call it again straight away
+			pause_session(session);
+			return true;
+		}
+	}
 }
 
-bool Jupiter::HTTP::Server::remove(std::string_view host, std::string_view path, std::string_view name) {
-	return m_data->remove(host, path, name);
+// Updates the session's share of the server's buffered output
+void Jupiter::HTTP::Server::Data::Worker::account_output(HTTPSession& session) {
+	size_t pending = session.output.size() - session.output_offset;
+	if (pending >= session.output_accounted) {
+		m_server.m_buffered_output += pending - session.output_accounted;
+	}
+	else {
+		m_server.m_buffered_output -= session.output_accounted - pending;
+	}
+	session.output_accounted = pending;
 }
 
-bool Jupiter::HTTP::Server::has(std::string_view host) {
-	return m_data->has(host);
+// Whether new output should wait for buffered output to drain; sessions are never dropped for exceeding the limit
+bool Jupiter::HTTP::Server::Data::Worker::output_limit_exceeded() const {
+	return m_server.m_buffered_output.load() > m_server.max_buffered_output.load();
 }
 
-bool Jupiter::HTTP::Server::has(std::string_view host, std::string_view name) {
-	return m_data->has(host, name);
+void Jupiter::HTTP::Server::Data::Worker::watch_session(HTTPSession& session, SessionWait in_wait) {
+	if (session.wait == in_wait) {
+		return;
+	}
+
+#if defined JUPITER_HTTP_EPOLL
+	if (m_epoll_fd >= 0) {
+		if (in_wait == SessionWait::HANDLER) {
+			// Removed entirely, since hangups are reported regardless of interest
+			epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, session.sock->getDescriptor(), nullptr);
+		}
+		else {
+			// Further requests aren't read while a response is being written, so the interest sets don't overlap
+			epoll_event event{};
+			switch (in_wait) {
+			case SessionWait::WRITE:
+				event.events = EPOLLOUT;
+				break;
+			case SessionWait::PAUSED:
+				event.events = EPOLLRDHUP;
+				break;
+			default:
+				event.events = EPOLLIN | EPOLLRDHUP;
+				break;
+			}
+			event.data.ptr = &session;
+			epoll_ctl(m_epoll_fd, session.wait == SessionWait::HANDLER ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, session.sock->getDescriptor(), &event);
+		}
+	}
+#endif // JUPITER_HTTP_EPOLL
+
+	session.wait = in_wait;
 }
 
-Jupiter::HTTP::Server::Content *Jupiter::HTTP::Server::find(std::string_view name) {
-	return m_data->find(name);
+// Stops waiting on the socket until the stream is resumed, or the retry interval passes; i.e: to recheck the output limit
+void Jupiter::HTTP::Server::Data::Worker::pause_session(HTTPSession& session) {
+	watch_session(session, SessionWait::PAUSED);
+	m_timers.cancel(session);
+	m_timers.schedule(session, std::chrono::steady_clock::now() + m_server.stream_retry_interval.load());
 }
 
-Jupiter::HTTP::Server::Content *Jupiter::HTTP::Server::find(std::string_view host, std::string_view name) {
-	return m_data->find(host, name);
+// Returns false if the session should be destroyed
+bool Jupiter::HTTP::Server::Data::Worker::resume_session(HTTPSession& session) {
+	watch_session(session, SessionWait::WRITE);
+	return service_session(session);
 }
 
-std::string* Jupiter::HTTP::Server::execute(std::string_view name, std::string_view query_string) {
-	return m_data->execute(name, query_string);
+void Jupiter::HTTP::Server::Data::Worker::resume_streams() {
+	std::vector<std::shared_ptr<StreamResumer::Stream>> streams;
+	{
+		std::lock_guard guard{ m_resumer->mutex };
+		streams.swap(m_resumer->streams);
+	}
+
+	// Streams which already ended, or aren't paused, are skipped; they're resumed at most once per wake
+	for (auto& stream : streams) {
+		HTTPSession* session = stream->session;
+		if (session != nullptr && session->wait == SessionWait::PAUSED && !resume_session(*session)) {
+			destroy_session(*session);
+		}
+	}
 }
 
-std::string* Jupiter::HTTP::Server::execute(std::string_view host, std::string_view name, std::string_view query_string) {
-	return m_data->execute(host, name, query_string);
+void Jupiter::HTTP::Server::Data::Worker::destroy_session(HTTPSession& session) {
+#if defined JUPITER_HTTP_EPOLL
+	if (m_epoll_fd >= 0) {
+		epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, session.sock->getDescriptor(), nullptr);
+	}
+#endif // JUPITER_HTTP_EPOLL
+
+	m_timers.cancel(session);
+	m_server.m_buffered_output -= session.output_accounted;
+	session.sock->close();
+	if (m_free_sessions.size() >= m_server.max_free_sessions.load()) {
+		m_sessions.erase(session.self);
+		return;
+	}
+
+	session.reset();
+	m_free_sessions.splice(m_free_sessions.begin(), m_sessions, session.self);
 }
 
-bool Jupiter::HTTP::Server::bind(std::string_view hostname, uint16_t port) {
-	auto socket = std::make_unique<Jupiter::TCPSocket>();
-	if (socket->bind(static_cast<std::string>(hostname).c_str(), port, true)) {
-		socket->setBlocking(false);
-		m_data->m_ports.push_back(std::move(socket));
-		return true;
+void Jupiter::HTTP::Server::Data::Worker::trim_sessions() {
+	auto now = std::chrono::steady_clock::now();
+	if (now < m_next_trim) {
+		return;
 	}
+	m_next_trim = now + m_server.session_pool_trim_interval;
 
-	return false;
+	// Sessions which stayed free for the whole interval weren't needed; free half of them, least recently used first
+	for (size_t count = m_free_low_water / 2; count != 0; --count) {
+		m_free_sessions.pop_back();
+	}
+	m_free_low_water = m_free_sessions.size();
 }
 
-bool Jupiter::HTTP::Server::tls_bind(std::string_view hostname, uint16_t port) {
-	auto socket = std::make_unique<Jupiter::SecureTCPSocket>();
-	if (socket->bind(static_cast<std::string>(hostname).c_str(), port, true)) {
-		m_data->m_ports.push_back(std::move(socket));
-		return true;
+// Sessions are only rescheduled when their timer is reached, rather than on each read or write; last_active is enough
+std::chrono::steady_clock::time_point Jupiter::HTTP::Server::Data::Worker::session_deadline(const HTTPSession& session) const {
+	std::chrono::milliseconds keep_alive_timeout = m_server.keep_alive_session_timeout;
+	if (session.keep_alive) {
+		return session.last_active + keep_alive_timeout;
 	}
 
-	return false;
+	return session.last_active + std::min<std::chrono::milliseconds>(m_server.session_timeout, keep_alive_timeout);
 }
 
-int Jupiter::HTTP::Server::think() {
-	// Process existing clients
-	for (auto itr = m_data->m_sessions.begin(); itr != m_data->m_sessions.end();) {
-		auto& session = *itr;
-		if (session->sock.isShutdown()) {
-			if (session->sock.recv() == 0) {
-				itr = m_data->m_sessions.erase(itr);
-				continue;
-			}
-		}
-		else if ((std::chrono::steady_clock::now() > session->last_active + m_data->keep_alive_session_timeout)
-			|| (session->keep_alive == false && std::chrono::steady_clock::now() > session->last_active + m_data->session_timeout)) {
-			itr = m_data->m_sessions.erase(itr);
-			continue;
+void Jupiter::HTTP::Server::Data::Worker::expire_sessions() {
+	trim_sessions();
+
+	auto now = std::chrono::steady_clock::now();
+	m_timers.advance(now, [this, now](HTTPSession& session) {
+		if (session.sock->isShutdown() || session.wait == SessionWait::HANDLER) {
+			m_timers.schedule(session, now + m_server.keep_alive_session_timeout.load());
+			return;
 		}
-		else if (session->sock.recv() > 0) {
-			std::string_view sock_buffer = session->sock.getBuffer();
-			if (session->request.size() + sock_buffer.size() <= m_data->max_request_size) { // accept
-				session->request += sock_buffer;
-				if (session->request.find(HTTP_REQUEST_ENDING) != std::string::npos) { // completed request
-					session->last_active = std::chrono::steady_clock::now();
-					m_data->process_request(*session);
-					if (session->keep_alive == false) { // remove completed session
-						itr = m_data->m_sessions.erase(itr);
-						//session->sock.shutdown();
-						continue;
-					}
-					// else // keep_alive: session not deleted
-				}
-				else if (session->request.size() == m_data->max_request_size) { // reject (full buffer)
-					itr = m_data->m_sessions.erase(itr);
-					continue;
-				}
-				// else // request not over: session not deleted
+
+		if (session.wait == SessionWait::PAUSED) { // Retry producers which never resume their stream, and sessions held by the output limit
+			// last_active is only refreshed by output actually sent, so producers which never finish still time out
+			if (now >= session.last_active + m_server.stream_timeout.load() || !resume_session(session)) {
+				destroy_session(session);
 			}
-			else { // reject
-				itr = m_data->m_sessions.erase(itr);
-				continue;
+			else if (session.timer_link == nullptr) {
+				m_timers.schedule(session, session_deadline(session));
 			}
+			return;
 		}
-		else if (session->sock.getLastError() != JUPITER_SOCK_EWOULDBLOCK) {
-			itr = m_data->m_sessions.erase(itr);
-			continue;
+
+		auto deadline = session_deadline(session);
+		if (deadline > now) {
+			m_timers.schedule(session, deadline);
+			return;
 		}
-		// else // EWOULDBLOCK: session not deleted
 
+		destroy_session(session);
+	});
+}
+
+// Milliseconds until the next session timer or pool trim is due
+int Jupiter::HTTP::Server::Data::Worker::poll_timeout() const {
+	auto next = std::min(m_timers.next_tick(), m_next_trim);
+	auto timeout = std::chrono::ceil<std::chrono::milliseconds>(next - std::chrono::steady_clock::now());
+	return static_cast<int>(std::clamp<std::chrono::milliseconds::rep>(timeout.count(), 0, std::numeric_limits<int>::max()));
+}
+
+void Jupiter::HTTP::Server::Data::Worker::poll_sessions() {
+	// Process existing clients
+	for (auto itr = m_sessions.begin(); itr != m_sessions.end();) {
+		HTTPSession& session = *itr;
 		++itr;
+
+		if (session.wait == SessionWait::HANDLER || session.wait == SessionWait::PAUSED) {
+			continue;
+		}
+
+		bool result;
+		if (session.handshaking) {
+			result = handshake_session(session);
+		}
+		else {
+			result = session.wait == SessionWait::WRITE ? service_session(session) : read_session(session);
+		}
+		if (!result) {
+			destroy_session(session);
+		}
 	}
 
 	// Process incoming clients
-	std::unique_ptr<Jupiter::Socket> socket;
-	for (auto& port : m_data->m_ports) {
-		socket.reset(port->accept());
-		if (socket != nullptr) {
-			socket->setBlocking(false);
-			auto session = std::make_unique<HTTPSession>(std::move(*socket));
-			if (session->sock.recv() > 0) { // data received
-				std::string_view sock_buffer = session->sock.getBuffer();
-				if (sock_buffer.size() < m_data->max_request_size) { // accept
-					session->request = session->sock.getBuffer();
-					if (sock_buffer.find(HTTP_REQUEST_ENDING) != std::string_view::npos) { // completed request
-						m_data->process_request(*session);
-						if (session->keep_alive) { // session will live for 30 seconds.
-							m_data->m_sessions.push_back(std::move(session));
-						}
-						// else // session completed
-					}
-					else { // store for more processing
-						m_data->m_sessions.push_back(std::move(session));
-					}
-				}
-				else if (sock_buffer.size() == m_data->max_request_size) {
-					if (sock_buffer.find(HTTP_REQUEST_ENDING) == std::string_view::npos) { // reject (too large)
-						continue;
-					}
+	for (auto& port : m_ports) {
+		accept_sessions(*port);
+	}
+}
 
-					// accept (max size, completed request)
-					session->request = session->sock.getBuffer();
-					m_data->process_request(*session);
-					if (session->keep_alive) { // session will live for 30 seconds.
-						m_data->m_sessions.push_back(std::move(session));
-					}
-					// else // session completed
-				}
-				// else // reject (too large)
-			}
-			else if (session->sock.getLastError() == JUPITER_SOCK_EWOULDBLOCK) { // store for more processing
-				m_data->m_sessions.push_back(std::move(session));
+#if defined JUPITER_HTTP_EPOLL
+void Jupiter::HTTP::Server::Data::Worker::poll_events(int timeout_ms) {
+	int event_count = epoll_wait(m_epoll_fd, m_events.data(), static_cast<int>(m_events.size()), timeout_ms);
+	for (int index = 0; index < event_count; ++index) {
+		const epoll_event& event = m_events[index];
+
+		if (event.data.ptr == this) { // woken up by wake()
+			eventfd_t counter;
+			eventfd_read(m_wake_fd, &counter);
+			continue;
+		}
+
+		// Listening ports share the readiness set with sessions; there's only ever a handful of them
+		auto port_itr = std::find_if(m_ports.begin(), m_ports.end(), [&event](const std::unique_ptr<Socket>& port) {
+			return port.get() == event.data.ptr;
+		});
+		if (port_itr != m_ports.end()) {
+			accept_sessions(**port_itr);
+			continue;
+		}
+
+		HTTPSession& session = *static_cast<HTTPSession*>(event.data.ptr);
+		if ((event.events & EPOLLERR) != 0) {
+			destroy_session(session);
+			continue;
+		}
+
+		if (session.wait == SessionWait::PAUSED) { // Only hangups are watched for while paused
+			if ((event.events & (EPOLLHUP | EPOLLRDHUP)) != 0) {
+				destroy_session(session);
 			}
+			continue;
 		}
+
+		bool result;
+		if (session.handshaking) {
+			result = handshake_session(session);
+		}
+		else {
+			result = (event.events & EPOLLOUT) != 0 ? service_session(session) : read_session(session);
+		}
+		if (!result) {
+			destroy_session(session);
+		}
+	}
+}
+#endif // JUPITER_HTTP_EPOLL
+
+void Jupiter::HTTP::Server::Data::Worker::run() {
+#if defined JUPITER_HTTP_EPOLL
+	while (m_running) {
+		adopt_ports();
+		expire_sessions();
+		poll_events(poll_timeout());
+		complete_requests();
+		resume_streams();
+	}
+#endif // JUPITER_HTTP_EPOLL
+}
+
+void Jupiter::HTTP::Server::Data::Worker::wake() {
+#if defined JUPITER_HTTP_EPOLL
+	if (m_wake_fd >= 0) {
+		eventfd_write(m_wake_fd, 1);
+	}
+#endif // JUPITER_HTTP_EPOLL
+}
+
+int Jupiter::HTTP::Server::think() {
+	Data::Worker& worker = m_data->m_local_worker;
+	worker.complete_requests();
+	worker.resume_streams();
+	worker.expire_sessions();
+
+#if defined JUPITER_HTTP_EPOLL
+	if (worker.m_epoll_fd >= 0) {
+		worker.poll_events(0);
+		return 0;
 	}
+#endif // JUPITER_HTTP_EPOLL
+
+	worker.poll_sessions();
 	return 0;
 }
+
+int Jupiter::HTTP::Server::getDescriptor() const {
+#if defined JUPITER_HTTP_EPOLL
+	return m_data->m_local_worker.m_epoll_fd;
+#else // JUPITER_HTTP_EPOLL
+	return -1;
+#endif // JUPITER_HTTP_EPOLL
+}
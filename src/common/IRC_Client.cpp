@@ -17,10 +17,12 @@
  */
 
 #include "IRC_Client.h"
+#include <algorithm>
 #include <cstring>
 #include <cstdio>
 #include <ctime>
 #include <charconv>
+#include <utility>
 #include "jessilib/split.hpp"
 #include "jessilib/word_split.hpp"
 #include "jessilib/unicode.hpp"
@@ -36,6 +38,8 @@
 
 using namespace std::literals;
 
+constexpr size_t s_max_line_pieces = 8; // Most pieces which Client::sendLine() sends without concatenating them
+
 Jupiter::IRC::Client::Client(Jupiter::Config *in_primary_section, Jupiter::Config *in_secondary_section) {
 	m_primary_section = in_primary_section;
 	m_secondary_section = in_secondary_section;
@@ -74,7 +78,14 @@ Jupiter::IRC::Client::Client(Jupiter::Config *in_primary_section, Jupiter::Confi
 
 	m_join_on_kick = Jupiter::IRC::Client::readConfigBool("AutoJoinOnKick"sv);
 	m_reconnect_delay = Jupiter::IRC::Client::readConfigInt("AutoReconnectDelay"sv);
+	m_connect_timeout = std::chrono::seconds(Jupiter::IRC::Client::readConfigInt("ConnectTimeout"sv, 30));
+	m_connection_attempt_delay = std::chrono::milliseconds(Jupiter::IRC::Client::readConfigInt("ConnectionAttemptDelay"sv, 250));
 	m_max_reconnect_attempts = Jupiter::IRC::Client::readConfigInt("MaxReconnectAttempts"sv);
+
+	// Socket tuning; options which aren't configured are left at the system's defaults
+	m_socket_options = Jupiter::Socket::Options::read([this](std::string_view key) {
+		return Jupiter::IRC::Client::readConfigValue(key);
+	});
 	m_server_port = (unsigned short)Jupiter::IRC::Client::readConfigInt("Port"sv, m_ssl ? 994 : 194);
 	m_default_chan_type = Jupiter::IRC::Client::readConfigInt("Channel.Type"sv);
 
@@ -242,6 +253,14 @@ int Jupiter::IRC::Client::getMaxReconnectAttempts() const {
 	return m_max_reconnect_attempts;
 }
 
+unsigned int Jupiter::IRC::Client::getTLSHandshakeCount() const {
+	return m_tls_handshakes;
+}
+
+unsigned int Jupiter::IRC::Client::getTLSResumptionCount() const {
+	return m_tls_resumptions;
+}
+
 int Jupiter::IRC::Client::getDefaultChanType() const {
 	return m_default_chan_type;
 }
@@ -278,7 +297,7 @@ int Jupiter::IRC::Client::getAccessLevel(std::string_view in_channel, std::strin
 }
 
 void Jupiter::IRC::Client::send(std::string_view rawMessage) {
-	m_socket->send(static_cast<std::string>(rawMessage) + "\r\n");
+	Client::sendLine({ rawMessage });
 }
 
 const Jupiter::IRC::Client::UserTableType &Jupiter::IRC::Client::getUsers() const {
@@ -324,15 +343,15 @@ void Jupiter::IRC::Client::setAutoReconnect(int val) {
 }
 
 void Jupiter::IRC::Client::joinChannel(std::string_view in_channel) {
-	m_socket->send(string_printf("JOIN %.*s" ENDL, in_channel.size(), in_channel.data()));
+	Client::sendLine({ "JOIN "sv, in_channel });
 }
 
 void Jupiter::IRC::Client::joinChannel(std::string_view in_channel, std::string_view in_password) {
-	m_socket->send(string_printf("JOIN %.*s %.*s" ENDL, in_channel.size(), in_channel.data(), in_password.size(), in_password.data()));
+	Client::sendLine({ "JOIN "sv, in_channel, " "sv, in_password });
 }
 
 void Jupiter::IRC::Client::partChannel(std::string_view in_channel) {
-	m_socket->send(string_printf("PART %.*s" ENDL, in_channel.size(), in_channel.data()));
+	Client::sendLine({ "PART "sv, in_channel });
 
 	auto channel = m_channels.find(JUPITER_WRAP_MAP_KEY(in_channel));
 	if (channel != m_channels.end()) {
@@ -341,7 +360,7 @@ void Jupiter::IRC::Client::partChannel(std::string_view in_channel) {
 }
 
 void Jupiter::IRC::Client::partChannel(std::string_view in_channel, std::string_view in_message) {
-	m_socket->send(string_printf("PART %.*s :%.*s" ENDL, in_channel.size(), in_channel.data(), in_message.size(), in_message.data()));
+	Client::sendLine({ "PART "sv, in_channel, " :"sv, in_message });
 
 	auto channel = m_channels.find(JUPITER_WRAP_MAP_KEY(in_channel));
 	if (channel != m_channels.end()) {
@@ -350,11 +369,11 @@ void Jupiter::IRC::Client::partChannel(std::string_view in_channel, std::string_
 }
 
 void Jupiter::IRC::Client::sendMessage(std::string_view dest, std::string_view message) {
-	m_socket->send(string_printf("PRIVMSG %.*s :%.*s" ENDL, dest.size(), dest.data(), message.size(), message.data()));
+	Client::sendLine({ "PRIVMSG "sv, dest, " :"sv, message });
 }
 
 void Jupiter::IRC::Client::sendNotice(std::string_view dest, std::string_view message) {
-	m_socket->send(string_printf("NOTICE %.*s :%.*s" ENDL, dest.size(), dest.data(), message.size(), message.data()));
+	Client::sendLine({ "NOTICE "sv, dest, " :"sv, message });
 }
 
 size_t Jupiter::IRC::Client::messageChannels(int type, std::string_view message) {
@@ -453,26 +472,12 @@ int Jupiter::IRC::Client::process_line(std::string_view line) {
 							Jupiter::SecureTCPSocket *t = new Jupiter::SecureTCPSocket(std::move(*m_socket));
 							m_socket.reset(t);
 							m_ssl = true;
-							// toggle blocking to prevent error
 							if (!m_ssl_certificate.empty())
 								t->setCertificate(m_ssl_certificate, m_ssl_key);
+							Client::offerTLSSession(*t);
 
-							bool goodSSL;
-							if (t->getBlockingMode() == false)
-							{
-								t->setBlocking(true);
-								goodSSL = t->initSSL();
-								t->setBlocking(false);
-							}
-							else goodSSL = t->initSSL();
-
-							if (goodSSL)
-								Client::startCAP();
-							else
-							{
-								// Something went wrong. Kill the socket.
-								t->close();
-							}
+							// The handshake is driven by think(), like any other connection
+							m_connection_status = -2;
 						}
 						break;
 
@@ -574,7 +579,7 @@ int Jupiter::IRC::Client::process_line(std::string_view line) {
 								m_nickname = configNick;
 								m_nickname += "1";
 								
-								m_socket->send("NICK "s + m_nickname + ENDL);
+								Client::sendLine({ "NICK "sv, m_nickname });
 							}
 							else if (jessilib::equalsi(m_nickname, configNick)) // The config nick failed
 							{
@@ -588,7 +593,7 @@ int Jupiter::IRC::Client::process_line(std::string_view line) {
 								else
 									m_nickname = altNick;
 
-								m_socket->send("NICK "s + m_nickname + ENDL);
+								Client::sendLine({ "NICK "sv, m_nickname });
 							}
 							// Note: Add a series of contains() functions to String_Type.
 							else
@@ -601,7 +606,7 @@ int Jupiter::IRC::Client::process_line(std::string_view line) {
 										m_nickname = configNick;
 										m_nickname += std::to_string(n + 1);
 
-										m_socket->send("NICK "s + m_nickname + ENDL);
+										Client::sendLine({ "NICK "sv, m_nickname });
 									}
 									else
 									{
@@ -609,7 +614,7 @@ int Jupiter::IRC::Client::process_line(std::string_view line) {
 										// This can be somewhat edgy -- this will only trigger if someone rehashes AND the new nickname is shorter.
 										// However, it won't be fatal even if the new nickname's length is >= the old.
 										m_nickname = configNick;
-										m_socket->send("NICK "s + m_nickname + ENDL);
+										Client::sendLine({ "NICK "sv, m_nickname });
 									}
 								}
 								else
@@ -1070,7 +1075,7 @@ int Jupiter::IRC::Client::process_line(std::string_view line) {
 			{
 				if (w1 == "PING"sv)
 				{
-					m_socket->send(string_printf("PONG %.*s" ENDL, first_split.second.size(), first_split.second.data()));
+					Client::sendLine({ "PONG "sv, first_split.second });
 				}
 				else if (w1 == "NICK"sv)
 				{
@@ -1094,7 +1099,7 @@ int Jupiter::IRC::Client::process_line(std::string_view line) {
 						std::string auth_str = m_nickname + '\0' + m_sasl_account + '\0' + m_sasl_password;
 
 						char *enc = Jupiter::base64encode(auth_str.data(), auth_str.size());
-						m_socket->send("AUTHENTICATE "s + enc + ENDL);
+						Client::sendLine({ "AUTHENTICATE "sv, enc });
 						delete[] enc;
 					}
 					m_socket->send("CAP END" ENDL);
@@ -1120,24 +1125,65 @@ int Jupiter::IRC::Client::process_line(std::string_view line) {
 
 bool Jupiter::IRC::Client::connect() {
 	std::string_view clientAddress = Jupiter::IRC::Client::readConfigValue("ClientAddress"sv);
-	if (m_socket->connect(m_server_hostname.c_str(), m_server_port, clientAddress.empty() ? nullptr : static_cast<std::string>(clientAddress).c_str(), (unsigned short)Jupiter::IRC::Client::readConfigLong("ClientPort"sv)) == false)
+	m_tls_session_server = m_server_hostname + ':' + std::to_string(m_server_port);
+	auto secure_socket = dynamic_cast<Jupiter::SecureSocket*>(m_socket.get());
+	if (secure_socket != nullptr)
+		Client::offerTLSSession(*secure_socket);
+
+	// Lines are parsed in place over the socket's buffer; drop anything left from the last connection
+	m_socket->setRetainBuffer(true);
+	m_socket->clearBuffer();
+
+	m_socket->setConnectTimeout(m_connect_timeout);
+	m_socket->setConnectionAttemptDelay(m_connection_attempt_delay);
+	m_socket->setOptions(m_socket_options);
+	if (m_socket->startConnect(m_server_hostname.c_str(), m_server_port, clientAddress.empty() ? nullptr : static_cast<std::string>(clientAddress).c_str(), (unsigned short)Jupiter::IRC::Client::readConfigLong("ClientPort"sv)) == false) {
+		Client::finishConnect(false);
 		return false;
-
-	m_socket->setBlocking(false);
-	if (m_ssl == false && Jupiter::IRC::Client::readConfigBool("STARTTLS"sv, true))
-	{
-		m_socket->send("STARTTLS" ENDL);
-		m_connection_status = 1;
 	}
-	else
-		Client::startCAP();
 
+	// Connecting; completed by think()
+	m_connection_status = -1;
 	return true;
 }
 
+void Jupiter::IRC::Client::finishConnect(bool in_success) {
+	bool starttls = m_connection_status == -2;
+	if (in_success) {
+		auto secure_socket = dynamic_cast<Jupiter::SecureSocket*>(m_socket.get());
+		if (secure_socket != nullptr)
+			Client::countTLSHandshake(*secure_socket);
+
+		if (m_ssl == false && Jupiter::IRC::Client::readConfigBool("STARTTLS"sv, true))
+		{
+			m_socket->send("STARTTLS" ENDL);
+			m_connection_status = 1;
+		}
+		else
+			Client::startCAP();
+	}
+	else if (starttls) {
+		// The connection was already established; treat this like any other disconnect
+		Jupiter::IRC::Client::disconnect();
+	}
+	else {
+		m_connection_status = 0;
+		m_socket->close();
+		m_reconnect_time = time(0) + m_reconnect_delay;
+	}
+
+	if (std::exchange(m_reconnecting, false)) {
+		this->OnReconnectAttempt(in_success);
+		for (auto& plugin : Jupiter::plugins) {
+			plugin->OnReconnectAttempt(this, in_success);
+		}
+	}
+}
+
 void Jupiter::IRC::Client::disconnect(bool stayDead)
 {
 	m_connection_status = 0;
+	Client::saveTLSSession();
 	m_socket->close();
 	m_reconnect_time = time(0) + m_reconnect_delay;
 	m_dead = stayDead;
@@ -1167,19 +1213,55 @@ void Jupiter::IRC::Client::disconnect(bool stayDead)
 
 void Jupiter::IRC::Client::disconnect(std::string_view message, bool stayDead)
 {
-	m_socket->send(string_printf("QUIT :%.*s" ENDL, message.size(), message.data()));
+	Client::sendLine({ "QUIT :"sv, message });
 	Jupiter::IRC::Client::disconnect(stayDead);
 }
 
+int Jupiter::IRC::Client::sendLine(std::initializer_list<std::string_view> in_pieces) {
+	if (in_pieces.size() > s_max_line_pieces) {
+		// Rare enough not to warrant a larger array; concatenate, rather than truncate the line
+		std::string line;
+		for (std::string_view piece : in_pieces) {
+			line += piece;
+		}
+		line += ENDL ""sv;
+		return m_socket->send(line);
+	}
+
+	std::string_view buffers[s_max_line_pieces + 1];
+	std::copy(in_pieces.begin(), in_pieces.end(), buffers);
+	buffers[in_pieces.size()] = ENDL ""sv;
+	return m_socket->sendv({ buffers, in_pieces.size() + 1 });
+}
+
+void Jupiter::IRC::Client::offerTLSSession(Jupiter::SecureSocket &in_socket) {
+	auto session = m_tls_sessions.find(m_tls_session_server);
+	in_socket.setSession(session != m_tls_sessions.end() ? session->second : nullptr);
+}
+
+void Jupiter::IRC::Client::countTLSHandshake(const Jupiter::SecureSocket &in_socket) {
+	++m_tls_handshakes;
+	if (in_socket.isSessionReused())
+		++m_tls_resumptions;
+}
+
+void Jupiter::IRC::Client::saveTLSSession() {
+	// TLS 1.3 session tickets arrive after the handshake, so fetch the session as late as possible
+	auto secure_socket = dynamic_cast<Jupiter::SecureSocket*>(m_socket.get());
+	if (secure_socket == nullptr || m_tls_session_server.empty())
+		return;
+
+	auto session = secure_socket->getSession();
+	if (session != nullptr)
+		m_tls_sessions[m_tls_session_server] = std::move(session);
+}
+
 void Jupiter::IRC::Client::reconnect()
 {
 	if (m_connection_status != 0) Jupiter::IRC::Client::disconnect();
 	m_reconnect_attempts++;
-	bool successConnect = Jupiter::IRC::Client::connect();
-	this->OnReconnectAttempt(successConnect);
-	for (auto& plugin : Jupiter::plugins) {
-		plugin->OnReconnectAttempt(this, successConnect);
-	}
+	m_reconnecting = true; // OnReconnectAttempt() is called by finishConnect()
+	Jupiter::IRC::Client::connect();
 }
 
 int Jupiter::IRC::Client::think() {
@@ -1200,48 +1282,50 @@ int Jupiter::IRC::Client::think() {
 	if (m_connection_status == 0)
 		return handle_error(-1);
 
-	int tmp = m_socket->recv();
-	if (tmp > 0) {
-		// Process incoming data
-		using namespace std::literals;
-		auto tokens = jessilib::split_view(m_socket->getBuffer(), "\r\n"sv);
-		if (tokens.size() != 0) {
-			if (tokens[0].size() > 0) {
-				// Ensure there's not a token getting split over separate buffers
-				std::string_view token_0 = tokens[0];
-				if (m_last_line.size() > 0) {
-					if (tokens[0][0] == '\n' && m_last_line[m_last_line.size() - 1] == '\r') {
-						m_last_line.pop_back();
-						Jupiter::IRC::Client::process_line(m_last_line);
-						m_last_line.erase();
-
-						token_0.remove_prefix(1);
-					}
-				}
+	if (m_connection_status < 0) {
+		// Still connecting or performing the TLS handshake; this never blocks
+		int result = m_socket->continueConnect();
+		if (result != 0)
+			Client::finishConnect(result > 0);
 
-				m_last_line += token_0;
-			}
+		return 0;
+	}
 
-			if (tokens.size() != 1) {
-				Jupiter::IRC::Client::process_line(m_last_line);
-				m_last_line = tokens[tokens.size() - 1];
+	int tmp = m_socket->recv();
+	while (tmp > 0) {
+		// Process every complete line in place; a partial line is left in the buffer until the rest arrives
+		while (true) {
+			std::string_view buffer = m_socket->getBuffer();
+			size_t line_end = buffer.find("\r\n"sv);
+			if (line_end == std::string_view::npos) {
+				break;
+			}
 
-				for (size_t index = 1; index != tokens.size() - 1; ++index) {
-					if (Jupiter::IRC::Client::process_line(tokens[index]) != 0) {
-						return handle_error(1);
-					}
-				}
+			// Consumed before processing, since processing may move the socket (i.e: STARTTLS)
+			m_socket->consumeBuffer(line_end + 2);
+			if (line_end != 0 && Jupiter::IRC::Client::process_line(buffer.substr(0, line_end)) != 0) {
+				return handle_error(1);
 			}
 		}
 
-		return 0;
+		// Decrypted data doesn't make the socket readable again, so read it now rather than waiting on getDescriptor()
+		auto secure_socket = dynamic_cast<Jupiter::SecureSocket*>(m_socket.get());
+		if (m_connection_status <= 0 || secure_socket == nullptr || secure_socket->getPending() == 0) {
+			return 0;
+		}
+
+		tmp = m_socket->recv();
 	}
 
 	// No incoming data; check for errors
-	tmp = m_socket->getLastError();
+	if (tmp == 0) // Connection closed by the server; errno is left over from some earlier call
+		tmp = -1;
+	else {
+		tmp = m_socket->getLastError();
 
-	if (tmp == JUPITER_SOCK_EWOULDBLOCK) // Operation would block
-		return 0;
+		if (tmp == JUPITER_SOCK_EWOULDBLOCK) // Operation would block
+			return 0;
+	}
 
 	// Serious error; disconnect if necessary
 	if (m_connection_status != 0)
@@ -1250,6 +1334,15 @@ int Jupiter::IRC::Client::think() {
 	return handle_error(tmp);
 }
 
+int Jupiter::IRC::Client::getDescriptor() const {
+	// Connecting and handshaking are driven by interval, since they may wait on writability
+	if (m_connection_status <= 0) {
+		return -1;
+	}
+
+	return static_cast<int>(m_socket->getDescriptor());
+}
+
 std::string_view Jupiter::IRC::Client::readConfigValue(std::string_view key, std::string_view defaultValue) const {
 	if (m_primary_section != nullptr) {
 		std::string_view val = m_primary_section->get(key);
@@ -1411,14 +1504,10 @@ bool Jupiter::IRC::Client::startCAP() {
 bool Jupiter::IRC::Client::registerClient() {
 	bool result = true;
 	const char *localHostname = Jupiter::Socket::getLocalHostname();
-	std::string message = string_printf("USER %.*s %s %.*s :%.*s" ENDL, m_nickname.size(), m_nickname.data(), localHostname, m_server_hostname.size(), m_server_hostname.c_str(), m_realname.size(), m_realname.data());
-	
-	if (m_socket->send(message) <= 0)
+	if (Client::sendLine({ "USER "sv, m_nickname, " "sv, localHostname, " "sv, m_server_hostname, " :"sv, m_realname }) <= 0)
 		result = false;
 
-	message = string_printf("NICK %.*s" ENDL, m_nickname.size(), m_nickname.data());
-
-	if (m_socket->send(message) <= 0)
+	if (Client::sendLine({ "NICK "sv, m_nickname }) <= 0)
 		result = false;
 
 	m_connection_status = 3;
@@ -46,29 +46,37 @@ public:
 	}
 };
 
-/** List of Rehashable objects */
-std::list<Jupiter::Rehashable *> o_rehashables;
+/** List of Rehashable objects; constructed on first use, since Rehashables may be added during static initialization */
+static std::list<Jupiter::Rehashable *> &rehashables()
+{
+	static std::list<Jupiter::Rehashable *> s_rehashables;
+	return s_rehashables;
+}
 
-/** List of RehashFunction objects */
-std::list<RehashFunction *> o_rehash_functions;
+/** List of RehashFunction objects; constructed on first use, for the same reason */
+static std::list<RehashFunction *> &rehash_functions()
+{
+	static std::list<RehashFunction *> s_rehash_functions;
+	return s_rehash_functions;
+}
 
 Jupiter::Rehashable::Rehashable()
 {
-	o_rehashables.push_back(this);
+	rehashables().push_back(this);
 }
 
 Jupiter::Rehashable::Rehashable(const Jupiter::Rehashable &)
 {
-	o_rehashables.push_back(this);
+	rehashables().push_back(this);
 }
 
 Jupiter::Rehashable::~Rehashable()
 {
-	for (auto node = o_rehashables.begin(); node != o_rehashables.end(); ++node)
+	for (auto node = rehashables().begin(); node != rehashables().end(); ++node)
 	{
 		if (*node == this)
 		{
-			o_rehashables.erase(node);
+			rehashables().erase(node);
 			break;
 		}
 	}
@@ -78,9 +86,9 @@ size_t Jupiter::rehash()
 {
 	size_t total_errors = 0;
 	int rehash_result;
-	auto node = o_rehashables.begin();
+	auto node = rehashables().begin();
 
-	while (node != o_rehashables.end())
+	while (node != rehashables().end())
 	{
 		rehash_result = (*node)->OnRehash();
 		if (rehash_result != 0)
@@ -94,7 +102,7 @@ size_t Jupiter::rehash()
 				if ((*dead_node)->OnBadRehash(true))
 					delete *dead_node;
 
-				o_rehashables.erase(dead_node);
+				rehashables().erase(dead_node);
 
 				continue;
 			}
@@ -110,22 +118,22 @@ size_t Jupiter::rehash()
 
 size_t Jupiter::getRehashableCount()
 {
-	return o_rehashables.size();
+	return rehashables().size();
 }
 
 void Jupiter::addOnRehash(OnRehashFunctionType in_function)
 {
-	o_rehash_functions.push_back(new RehashFunction(in_function));
+	rehash_functions().push_back(new RehashFunction(in_function));
 }
 
 bool Jupiter::removeOnRehash(OnRehashFunctionType in_function)
 {
-	for (auto node = o_rehash_functions.begin(); node != o_rehash_functions.end(); ++node)
+	for (auto node = rehash_functions().begin(); node != rehash_functions().end(); ++node)
 	{
 		if ((*node)->m_function == in_function)
 		{
 			delete *node;
-			o_rehash_functions.erase(node);
+			rehash_functions().erase(node);
 			return true;
 		}
 	}
@@ -135,12 +143,12 @@ bool Jupiter::removeOnRehash(OnRehashFunctionType in_function)
 
 size_t Jupiter::removeAllOnRehash()
 {
-	size_t result = o_rehash_functions.size();
+	size_t result = rehash_functions().size();
 
-	while (o_rehash_functions.size() != 0)
+	while (rehash_functions().size() != 0)
 	{
-		delete o_rehash_functions.front();
-		o_rehash_functions.pop_front();
+		delete rehash_functions().front();
+		rehash_functions().pop_front();
 	}
 
 	return result;
@@ -0,0 +1,322 @@
+/**
+ * Copyright (C) 2021 Jessica James.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Written by Jessica James <jessica.aj@outlook.com>
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#if defined _WIN32
+#include <WinSock2.h>
+#include <ws2tcpip.h>
+#else // _WIN32
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#endif // _WIN32
+
+#include "Resolver.h"
+
+constexpr std::chrono::seconds s_default_positive_ttl{ 300 }; // See setPositiveTTL()
+constexpr std::chrono::seconds s_default_negative_ttl{ 30 }; // See setNegativeTTL()
+constexpr size_t s_default_thread_count = 2; // See setThreadCount()
+constexpr size_t s_max_cache_size = 1024; // Expired entries are pruned once the cache grows to this size
+constexpr std::chrono::seconds s_idle_thread_timeout{ 60 }; // Lookup threads exit after being idle this long
+
+struct Jupiter::Resolver::Data {
+	struct Entry {
+		std::shared_future<Addresses> result;
+		std::chrono::steady_clock::time_point expires = std::chrono::steady_clock::time_point::max(); // Max until the lookup completes
+		uint64_t id = 0; // Identifies the lookup which will complete this entry
+	};
+
+	struct Job {
+		std::string hostname;
+		std::promise<Addresses> promise;
+		uint64_t id;
+	};
+
+	mutable std::mutex mutex;
+	std::condition_variable condition;
+	std::unordered_map<std::string, Entry> cache; // Keyed by lowercase hostname
+	std::deque<Job> queue;
+	Lookup lookup;
+	std::chrono::seconds positive_ttl = s_default_positive_ttl;
+	std::chrono::seconds negative_ttl = s_default_negative_ttl;
+	size_t thread_count = s_default_thread_count;
+	size_t worker_count = 0;
+	size_t idle_count = 0;
+	size_t lookup_count = 0;
+	uint64_t next_id = 0;
+	bool stopping = false;
+};
+
+/** addrinfo allocated by the resolver; one allocation per address */
+struct AddrInfoNode {
+	addrinfo info{};
+	sockaddr_storage address{};
+};
+
+// Appends copies of a system addrinfo list, so that every list handed out is freed the same way
+static addrinfo **append_addrinfo(const addrinfo *in_source, addrinfo **out_tail) {
+	for (; in_source != nullptr; in_source = in_source->ai_next) {
+		AddrInfoNode *node = new AddrInfoNode;
+		node->info = *in_source;
+		node->info.ai_canonname = nullptr;
+		node->info.ai_next = nullptr;
+		node->info.ai_addrlen = std::min<socklen_t>(in_source->ai_addrlen, sizeof(node->address));
+		std::memcpy(&node->address, in_source->ai_addr, node->info.ai_addrlen);
+		node->info.ai_addr = reinterpret_cast<sockaddr *>(&node->address);
+
+		*out_tail = &node->info;
+		out_tail = &node->info.ai_next;
+	}
+
+	return out_tail;
+}
+
+static bool is_numeric_address(const std::string &in_hostname) {
+	addrinfo hints{};
+	hints.ai_flags = AI_NUMERICHOST;
+	addrinfo *result{};
+	if (getaddrinfo(in_hostname.c_str(), nullptr, &hints, &result) != 0) {
+		return false;
+	}
+
+	freeaddrinfo(result);
+	return true;
+}
+
+Jupiter::Resolver::Resolver()
+	: m_data{ std::make_shared<Data>() } {
+}
+
+Jupiter::Resolver::~Resolver() {
+	std::lock_guard<std::mutex> guard{ m_data->mutex };
+	m_data->stopping = true;
+	m_data->queue.clear();
+	m_data->condition.notify_all();
+}
+
+Jupiter::Resolver &Jupiter::Resolver::instance() { // static
+	static Resolver s_instance;
+	return s_instance;
+}
+
+std::shared_future<Jupiter::Resolver::Addresses> Jupiter::Resolver::resolve(std::string_view hostname) {
+	std::string key{ hostname };
+	std::transform(key.begin(), key.end(), key.begin(), [](unsigned char in_chr) { return static_cast<char>(std::tolower(in_chr)); });
+
+	if (is_numeric_address(key)) {
+		std::promise<Addresses> promise;
+		promise.set_value(Addresses{ std::string{ hostname } });
+		return promise.get_future().share();
+	}
+
+	std::unique_lock<std::mutex> lock{ m_data->mutex };
+	auto now = std::chrono::steady_clock::now();
+	auto itr = m_data->cache.find(key);
+	if (itr != m_data->cache.end() && now < itr->second.expires) {
+		return itr->second.result;
+	}
+
+	if (m_data->cache.size() >= s_max_cache_size) {
+		std::erase_if(m_data->cache, [now](const auto &in_entry) { return in_entry.second.expires <= now; });
+	}
+
+	Data::Job job{ key, {}, ++m_data->next_id };
+	Data::Entry &entry = m_data->cache[key];
+	entry.result = job.promise.get_future().share();
+	entry.expires = std::chrono::steady_clock::time_point::max();
+	entry.id = job.id;
+	std::shared_future<Addresses> result = entry.result;
+
+	m_data->queue.push_back(std::move(job));
+	++m_data->lookup_count;
+	if (m_data->idle_count != 0 || m_data->worker_count >= std::max<size_t>(m_data->thread_count, 1)) {
+		m_data->condition.notify_one();
+		return result;
+	}
+
+	std::thread{ &Jupiter::Resolver::runLookups, m_data }.detach();
+	++m_data->worker_count;
+	return result;
+}
+
+// Performs queued lookups until there are none for a while, or the resolver is destroyed
+void Jupiter::Resolver::runLookups(std::shared_ptr<Data> in_data) { // static
+	std::unique_lock<std::mutex> lock{ in_data->mutex };
+	while (true) {
+		++in_data->idle_count;
+		in_data->condition.wait_for(lock, s_idle_thread_timeout, [&in_data]() { return in_data->stopping || !in_data->queue.empty(); });
+		--in_data->idle_count;
+		if (in_data->stopping || in_data->queue.empty()) {
+			break;
+		}
+
+		Data::Job job = std::move(in_data->queue.front());
+		in_data->queue.pop_front();
+		Lookup lookup = in_data->lookup;
+		lock.unlock();
+
+		// Nothing above the lookup thread could catch an exception; fail the lookup instead, so that it's negatively cached
+		Addresses addresses;
+		try {
+			addresses = lookup ? lookup(job.hostname) : systemLookup(job.hostname);
+		}
+		catch (...) {
+			addresses.clear();
+		}
+
+		lock.lock();
+		auto itr = in_data->cache.find(job.hostname);
+		if (itr != in_data->cache.end() && itr->second.id == job.id) {
+			itr->second.expires = std::chrono::steady_clock::now() + (addresses.empty() ? in_data->negative_ttl : in_data->positive_ttl);
+		}
+
+		lock.unlock();
+		job.promise.set_value(std::move(addresses));
+		lock.lock();
+	}
+
+	--in_data->worker_count;
+}
+
+addrinfo *Jupiter::Resolver::getAddrInfo(const char *hostname, const char *port, const addrinfo *hints) {
+	if (hostname == nullptr || *hostname == '\0') {
+		// Nothing to look up (i.e: a wildcard address); defer to the system
+		addrinfo *system_result{};
+		if (getaddrinfo(hostname, port, hints, &system_result) != 0) {
+			return nullptr;
+		}
+
+		addrinfo *result{};
+		append_addrinfo(system_result, &result);
+		freeaddrinfo(system_result);
+		return result;
+	}
+
+	return makeAddrInfo(resolve(hostname).get(), port, hints);
+}
+
+addrinfo *Jupiter::Resolver::makeAddrInfo(const Addresses &addresses, const char *port, const addrinfo *hints) { // static
+	addrinfo numeric_hints{};
+	if (hints != nullptr) {
+		numeric_hints.ai_flags = hints->ai_flags & ~AI_CANONNAME;
+		numeric_hints.ai_family = hints->ai_family;
+		numeric_hints.ai_socktype = hints->ai_socktype;
+		numeric_hints.ai_protocol = hints->ai_protocol;
+	}
+	numeric_hints.ai_flags |= AI_NUMERICHOST;
+
+	addrinfo *result{};
+	addrinfo **tail = &result;
+	for (const std::string &address : addresses) {
+		addrinfo *system_result{};
+		if (getaddrinfo(address.c_str(), port, &numeric_hints, &system_result) == 0) {
+			tail = append_addrinfo(system_result, tail);
+			freeaddrinfo(system_result);
+		}
+	}
+
+	return result;
+}
+
+void Jupiter::Resolver::freeAddrInfo(addrinfo *info) { // static
+	while (info != nullptr) {
+		addrinfo *next = info->ai_next;
+		delete reinterpret_cast<AddrInfoNode *>(info);
+		info = next;
+	}
+}
+
+Jupiter::Resolver::Addresses Jupiter::Resolver::systemLookup(const std::string &hostname) { // static
+	Addresses result;
+	addrinfo hints{};
+	hints.ai_socktype = SOCK_STREAM; // One result per address, rather than one per socket type
+	addrinfo *info_head{};
+	if (getaddrinfo(hostname.c_str(), nullptr, &hints, &info_head) != 0) {
+		return result;
+	}
+
+	for (addrinfo *info = info_head; info != nullptr; info = info->ai_next) {
+		char address[NI_MAXHOST];
+		if (getnameinfo(info->ai_addr, info->ai_addrlen, address, sizeof(address), nullptr, 0, NI_NUMERICHOST) == 0
+			&& std::find(result.begin(), result.end(), address) == result.end()) {
+			result.emplace_back(address);
+		}
+	}
+
+	freeaddrinfo(info_head);
+	return result;
+}
+
+void Jupiter::Resolver::setLookup(Lookup in_lookup) {
+	std::lock_guard<std::mutex> guard{ m_data->mutex };
+	m_data->lookup = std::move(in_lookup);
+	m_data->cache.clear();
+}
+
+void Jupiter::Resolver::setPositiveTTL(std::chrono::seconds in_ttl) {
+	std::lock_guard<std::mutex> guard{ m_data->mutex };
+	m_data->positive_ttl = in_ttl;
+}
+
+std::chrono::seconds Jupiter::Resolver::getPositiveTTL() const {
+	std::lock_guard<std::mutex> guard{ m_data->mutex };
+	return m_data->positive_ttl;
+}
+
+void Jupiter::Resolver::setNegativeTTL(std::chrono::seconds in_ttl) {
+	std::lock_guard<std::mutex> guard{ m_data->mutex };
+	m_data->negative_ttl = in_ttl;
+}
+
+std::chrono::seconds Jupiter::Resolver::getNegativeTTL() const {
+	std::lock_guard<std::mutex> guard{ m_data->mutex };
+	return m_data->negative_ttl;
+}
+
+void Jupiter::Resolver::setThreadCount(size_t in_thread_count) {
+	std::lock_guard<std::mutex> guard{ m_data->mutex };
+	m_data->thread_count = in_thread_count;
+}
+
+size_t Jupiter::Resolver::getThreadCount() const {
+	std::lock_guard<std::mutex> guard{ m_data->mutex };
+	return m_data->thread_count;
+}
+
+size_t Jupiter::Resolver::getCacheSize() const {
+	std::lock_guard<std::mutex> guard{ m_data->mutex };
+	return m_data->cache.size();
+}
+
+size_t Jupiter::Resolver::getLookupCount() const {
+	std::lock_guard<std::mutex> guard{ m_data->mutex };
+	return m_data->lookup_count;
+}
+
+void Jupiter::Resolver::clear() {
+	std::lock_guard<std::mutex> guard{ m_data->mutex };
+	m_data->cache.clear();
+}
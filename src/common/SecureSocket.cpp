@@ -16,28 +16,48 @@
  * Written by Jessica James <jessica.aj@outlook.com>
  */
 
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 #include <utility> // std::move
+#include <vector>
 #include <openssl/ssl.h> // OpenSSL SSL functions
 #include <openssl/err.h> // OpenSSL SSL errors
 #include "SecureSocket.h"
+#include "Rehash.h"
+
+#if defined _WIN32
+#include <WinSock2.h>
+#else // _WIN32
+#include <cerrno>
+#endif // _WIN32
+
+constexpr size_t s_max_record_size = 16384; // Maximum plaintext in a TLS record; sendv() coalesces buffers up to this
 
 struct Jupiter::SecureSocket::SSLData {
 	SSL* handle = nullptr;
-    SSL_CTX* context = nullptr;
+	std::shared_ptr<SSL_CTX> context; // Shared with every other socket using the same settings; see SSLContextRegistry
+	uint64_t context_generation = 0; // SSLContextRegistry generation which context was fetched at
 	const SSL_METHOD* method = nullptr;
 	std::string cert;
 	std::string key;
+	IOWait io_wait = IOWait::NONE;
+	std::chrono::steady_clock::time_point handshake_deadline = std::chrono::steady_clock::time_point::max(); // Set by continueConnect()
+	Session session; // Offered to the server by initSSL()
+	bool kernel_tls = false; // Whether to request kTLS offload from OpenSSL
 	~SSLData();
 };
 
 Jupiter::SecureSocket::SSLData::~SSLData() {
 	if (Jupiter::SecureSocket::SSLData::handle != nullptr) {
-		if (SSL_shutdown(Jupiter::SecureSocket::SSLData::handle) == 0) {
-			SSL_shutdown(Jupiter::SecureSocket::SSLData::handle);
-		}
+		// Send close_notify, but don't wait on the peer's
+		SSL_shutdown(Jupiter::SecureSocket::SSLData::handle);
 		SSL_free(Jupiter::SecureSocket::SSLData::handle);
 	}
-	if (Jupiter::SecureSocket::SSLData::context != nullptr) SSL_CTX_free(Jupiter::SecureSocket::SSLData::context);
 }
 
 Jupiter::SecureSocket &Jupiter::SecureSocket::operator=(Jupiter::SecureSocket &&source) {
@@ -73,46 +93,62 @@ Jupiter::SecureSocket::~SecureSocket() {
 	}
 }
 
-Jupiter::SecureSocket *Jupiter::SecureSocket::accept() {
-	SocketType tSock = SSL_accept(m_ssl_data->handle);
-	if (tSock > 0) {
-		SecureSocket *r = new SecureSocket(Jupiter::SecureSocket::getBufferSize());
-		r->setDescriptor(tSock);
-		r->setType(this->getType());
-		r->setProtocol(this->getProtocol());
-		return r;
-	}
-	return nullptr;
+static void set_last_error(int in_error) {
+#if defined _WIN32
+	WSASetLastError(in_error);
+#else // _WIN32
+	errno = in_error;
+#endif // _WIN32
 }
 
-bool Jupiter::SecureSocket::bind(const char *hostname, unsigned short iPort, bool andListen) {
-	return Jupiter::Socket::bind(hostname, iPort, andListen);
-}
+// Maps a failed SSL I/O call onto the usual socket conventions, so that callers can check for JUPITER_SOCK_EWOULDBLOCK
+// through Socket::getLastError() regardless of whether or not a socket is secure
+static int handle_ssl_error(SSL* in_handle, int in_result, Jupiter::SecureSocket::IOWait& out_wait) {
+	out_wait = Jupiter::SecureSocket::IOWait::NONE;
+	switch (SSL_get_error(in_handle, in_result)) {
+	case SSL_ERROR_WANT_READ:
+		out_wait = Jupiter::SecureSocket::IOWait::READ;
+		set_last_error(JUPITER_SOCK_EWOULDBLOCK);
+		return -1;
 
-void Jupiter::SecureSocket::shutdown() {
-	Jupiter::Socket::shutdown();
-	if (m_ssl_data != nullptr && m_ssl_data->handle != nullptr)
-	{
-		if (SSL_shutdown(m_ssl_data->handle) == 0) {
-			SSL_shutdown(m_ssl_data->handle);
-		}
+	case SSL_ERROR_WANT_WRITE:
+		out_wait = Jupiter::SecureSocket::IOWait::WRITE;
+		set_last_error(JUPITER_SOCK_EWOULDBLOCK);
+		return -1;
+
+	case SSL_ERROR_ZERO_RETURN: // close_notify received
+		return 0;
+
+	case SSL_ERROR_SYSCALL: // errno is already set
+		ERR_clear_error();
+		return in_result;
+
+	default:
+		// Errors are queued per thread; don't let this one spill over into some other socket's result
+		ERR_clear_error();
+		set_last_error(0);
+		return in_result < 0 ? in_result : -1;
 	}
 }
 
-void Jupiter::SecureSocket::close() {
-	Jupiter::Socket::close();
-	if (m_ssl_data != nullptr && m_ssl_data->handle != nullptr) {
-		if (SSL_shutdown(m_ssl_data->handle) == 0) {
-			SSL_shutdown(m_ssl_data->handle);
-		}
-		SSL_free(m_ssl_data->handle);
-		m_ssl_data->handle = nullptr;
+#if defined SSL_OP_ENABLE_KTLS && !defined OPENSSL_NO_KTLS
+#define JUPITER_KTLS
+#endif // SSL_OP_ENABLE_KTLS && !OPENSSL_NO_KTLS
+
+static void request_kernel_tls(SSL* in_handle, bool in_enabled) {
+#if defined JUPITER_KTLS
+	// OpenSSL hands the keys to the kernel once the handshake completes, if the kernel supports the cipher
+	if (in_enabled) {
+		SSL_set_options(in_handle, SSL_OP_ENABLE_KTLS);
 	}
+#endif // JUPITER_KTLS
 }
 
-const char *Jupiter::SecureSocket::getCipherName() const {
-	return SSL_CIPHER_get_name(SSL_get_current_cipher(m_ssl_data->handle));
+#if defined JUPITER_KTLS
+static bool is_kernel_tls_send(SSL* in_handle) {
+	return in_handle != nullptr && BIO_get_ktls_send(SSL_get_wbio(in_handle));
 }
+#endif // JUPITER_KTLS
 
 bool loadCertificate(SSL_CTX *context, const char *cert, const char *key) {
 	if (SSL_CTX_load_verify_locations(context, cert, key) != 1) ERR_print_errors_fp(stderr);
@@ -133,6 +169,361 @@ bool loadCertificate(SSL_CTX *context, const char *cert, const char *key) {
 	return true;
 }
 
+static SSL_CTX* create_server_context(const SSL_METHOD* method, const std::string& cert, const std::string& key) {
+	SSL_CTX* context = SSL_CTX_new(method);
+	if (context == nullptr) {
+		ERR_print_errors_fp(stderr);
+		return nullptr;
+	}
+
+	if (SSL_CTX_use_certificate_chain_file(context, cert.c_str()) <= 0
+		|| SSL_CTX_use_PrivateKey_file(context, key.c_str(), SSL_FILETYPE_PEM) <= 0
+		|| !SSL_CTX_check_private_key(context)) {
+		ERR_print_errors_fp(stderr);
+		SSL_CTX_free(context);
+		return nullptr;
+	}
+
+	// Writes may be retried from a different address once the socket is writable, and partially succeed
+	SSL_CTX_set_mode(context, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+	SSL_CTX_set_options(context, SSL_OP_NO_RENEGOTIATION);
+
+	// Returning clients resume with a session ID (TLS 1.2) or ticket; tickets are enabled by OpenSSL's defaults
+	static constexpr unsigned char s_session_id_context[] = "Jupiter";
+	SSL_CTX_set_session_cache_mode(context, SSL_SESS_CACHE_SERVER);
+	SSL_CTX_set_session_id_context(context, s_session_id_context, sizeof(s_session_id_context) - 1);
+	return context;
+}
+
+static SSL_CTX* create_client_context(const SSL_METHOD* method, const std::string& cert, const std::string& key) {
+	SSL_CTX* context = SSL_CTX_new(method);
+	if (context == nullptr) {
+		ERR_print_errors_fp(stderr);
+		return nullptr;
+	}
+
+	if (!cert.empty()) {
+		loadCertificate(context, cert.c_str(), key.c_str());
+	}
+
+	// sendv() writes from a copy, so a retried write may come from a different address
+	SSL_CTX_set_mode(context, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+	return context;
+}
+
+static int reload_ssl_contexts();
+
+/**
+* @brief Process-wide registry of SSL contexts, so that each combination of settings loads its certificate & key once,
+* and is shared by every socket using it. A rehash rebuilds every context; sockets pick up the new context for their
+* next connection, while existing connections keep the context they started with.
+*/
+class SSLContextRegistry {
+public:
+	struct Key {
+		const SSL_METHOD* method;
+		bool server;
+		std::string cert;
+		std::string key;
+
+		bool operator==(const Key&) const = default;
+	};
+
+	/**
+	* @brief Fetches the context for a combination of settings, creating it if necessary.
+	*
+	* @param in_key Settings of the context
+	* @param out_generation Set to the current generation, for comparison against generation()
+	* @return Shared context on success, nullptr otherwise
+	*/
+	std::shared_ptr<SSL_CTX> get(const Key& in_key, uint64_t& out_generation) {
+		std::lock_guard guard{ m_mutex };
+		out_generation = m_generation;
+		auto itr = m_contexts.find(in_key);
+		if (itr != m_contexts.end()) {
+			return itr->second;
+		}
+
+		std::shared_ptr<SSL_CTX> context = create(in_key);
+		if (context == nullptr) {
+			return nullptr;
+		}
+
+		m_contexts.emplace(in_key, context);
+		return context;
+	}
+
+	/**
+	* @brief Rebuilds every context, such as after certificates have been renewed.
+	* Contexts which fail to rebuild are kept as they were.
+	*
+	* @return Number of contexts which failed to rebuild
+	*/
+	int reload() {
+		std::vector<Key> keys;
+		{
+			std::lock_guard guard{ m_mutex };
+			keys.reserve(m_contexts.size());
+			for (const auto& entry : m_contexts) {
+				keys.push_back(entry.first);
+			}
+		}
+
+		// Files are read without holding the lock, so that new connections aren't held up
+		int failures = 0;
+		std::vector<std::pair<Key, std::shared_ptr<SSL_CTX>>> contexts;
+		for (Key& key : keys) {
+			std::shared_ptr<SSL_CTX> context = create(key);
+			if (context == nullptr) {
+				++failures;
+				continue;
+			}
+			contexts.emplace_back(std::move(key), std::move(context));
+		}
+
+		std::lock_guard guard{ m_mutex };
+		for (auto& entry : contexts) {
+			m_contexts[entry.first] = std::move(entry.second);
+		}
+		m_atomic_generation = ++m_generation;
+		return failures;
+	}
+
+	/**
+	* @brief Fetches the current generation, which changes whenever contexts are rebuilt. This doesn't lock.
+	*
+	* @return Current generation
+	*/
+	uint64_t generation() const {
+		return m_atomic_generation.load(std::memory_order_relaxed);
+	}
+
+	static SSLContextRegistry& instance() {
+		static SSLContextRegistry s_instance;
+		return s_instance;
+	}
+
+private:
+	struct KeyHash {
+		size_t operator()(const Key& in_key) const {
+			size_t result = std::hash<std::string>{}(in_key.cert);
+			result = result * 31 + std::hash<std::string>{}(in_key.key);
+			result = result * 31 + std::hash<const void*>{}(in_key.method);
+			return result * 2 + in_key.server;
+		}
+	};
+
+	static std::shared_ptr<SSL_CTX> create(const Key& in_key) {
+		SSL_CTX* context = in_key.server
+			? create_server_context(in_key.method, in_key.cert, in_key.key)
+			: create_client_context(in_key.method, in_key.cert, in_key.key);
+		if (context == nullptr) {
+			return nullptr;
+		}
+
+		return { context, &SSL_CTX_free };
+	}
+
+	std::mutex m_mutex;
+	std::unordered_map<Key, std::shared_ptr<SSL_CTX>, KeyHash> m_contexts;
+	uint64_t m_generation = 0;
+	std::atomic<uint64_t> m_atomic_generation{ 0 };
+};
+
+static int reload_ssl_contexts() {
+	return SSLContextRegistry::instance().reload();
+}
+
+/** Registers reload_ssl_contexts() when the library is loaded, since the rehash list can't be modified from other threads */
+struct SSLContextReloader
+{
+	SSLContextReloader();
+	~SSLContextReloader();
+} sslContextReloader;
+
+SSLContextReloader::SSLContextReloader()
+{
+	Jupiter::addOnRehash(&reload_ssl_contexts);
+}
+
+SSLContextReloader::~SSLContextReloader()
+{
+	Jupiter::removeOnRehash(&reload_ssl_contexts);
+}
+
+Jupiter::SecureSocket *Jupiter::SecureSocket::accept() {
+	auto result = std::make_unique<SecureSocket>(Jupiter::SecureSocket::getBufferSize());
+	if (!Jupiter::SecureSocket::accept(*result, true)) {
+		return nullptr;
+	}
+
+	return result.release();
+}
+
+bool Jupiter::SecureSocket::accept(Socket &out_socket, bool in_blocking) {
+	SecureSocket* secure_socket = dynamic_cast<SecureSocket*>(&out_socket);
+	if (secure_socket == nullptr || m_ssl_data->context == nullptr) {
+		return false;
+	}
+
+	// Pick up a context rebuilt by a rehash, such as for a renewed certificate
+	SSLContextRegistry& registry = SSLContextRegistry::instance();
+	if (registry.generation() != m_ssl_data->context_generation) {
+		auto context = registry.get({ TLS_server_method(), true, m_ssl_data->cert, m_ssl_data->key }, m_ssl_data->context_generation);
+		if (context != nullptr) {
+			m_ssl_data->context = std::move(context);
+		}
+	}
+
+	if (!Jupiter::Socket::accept(out_socket, in_blocking)) {
+		return false;
+	}
+
+	// Accepted sockets share the listener's context, and with it the session cache
+	SSLData& ssl_data = *secure_socket->m_ssl_data;
+	ssl_data.context = m_ssl_data->context;
+	ssl_data.io_wait = IOWait::NONE;
+	ssl_data.handle = SSL_new(ssl_data.context.get());
+	if (ssl_data.handle == nullptr || SSL_set_fd(ssl_data.handle, out_socket.getDescriptor()) == 0) {
+		ERR_print_errors_fp(stderr);
+		out_socket.close();
+		return false;
+	}
+
+	ssl_data.kernel_tls = m_ssl_data->kernel_tls;
+	request_kernel_tls(ssl_data.handle, ssl_data.kernel_tls);
+	SSL_set_accept_state(ssl_data.handle);
+	if (in_blocking && secure_socket->handshake() <= 0) {
+		out_socket.close();
+		return false;
+	}
+
+	return true;
+}
+
+int Jupiter::SecureSocket::handshake() {
+	if (m_ssl_data->handle == nullptr) {
+		return -1;
+	}
+
+	int result = SSL_do_handshake(m_ssl_data->handle);
+	if (result == 1) {
+		m_ssl_data->io_wait = IOWait::NONE;
+		return 1;
+	}
+
+	handle_ssl_error(m_ssl_data->handle, result, m_ssl_data->io_wait);
+	return m_ssl_data->io_wait == IOWait::NONE ? -1 : 0;
+}
+
+Jupiter::SecureSocket::IOWait Jupiter::SecureSocket::getIOWait() const {
+	return m_ssl_data->io_wait;
+}
+
+size_t Jupiter::SecureSocket::getPending() const {
+	if (m_ssl_data->handle == nullptr) {
+		return 0;
+	}
+
+	return static_cast<size_t>(SSL_pending(m_ssl_data->handle));
+}
+
+bool Jupiter::SecureSocket::bind(const char *hostname, unsigned short iPort, bool andListen) {
+	if (!Jupiter::Socket::bind(hostname, iPort, andListen)) {
+		return false;
+	}
+
+	if (andListen) {
+		m_ssl_data->context = SSLContextRegistry::instance().get({ TLS_server_method(), true, m_ssl_data->cert, m_ssl_data->key }, m_ssl_data->context_generation);
+		if (m_ssl_data->context == nullptr) {
+			Jupiter::Socket::close();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void Jupiter::SecureSocket::shutdown() {
+	if (m_ssl_data != nullptr && m_ssl_data->handle != nullptr) {
+		// Send close_notify while the socket can still write, but don't wait on the peer's
+		SSL_shutdown(m_ssl_data->handle);
+		ERR_clear_error();
+	}
+	Jupiter::Socket::shutdown();
+}
+
+void Jupiter::SecureSocket::close() {
+	if (m_ssl_data != nullptr && m_ssl_data->handle != nullptr
+		&& SSL_is_init_finished(m_ssl_data->handle) == 1
+		&& (SSL_get_shutdown(m_ssl_data->handle) & SSL_SENT_SHUTDOWN) == 0) {
+		// Without a close_notify, OpenSSL marks the session as not resumable when the handle is freed
+		SSL_shutdown(m_ssl_data->handle);
+		ERR_clear_error();
+	}
+	Jupiter::Socket::close();
+	if (m_ssl_data != nullptr && m_ssl_data->handle != nullptr) {
+		SSL_free(m_ssl_data->handle);
+		m_ssl_data->handle = nullptr;
+	}
+}
+
+Jupiter::SecureSocket::Session Jupiter::SecureSocket::getSession() const {
+	if (m_ssl_data->handle == nullptr) {
+		return nullptr;
+	}
+
+	SSL_SESSION* session = SSL_get1_session(m_ssl_data->handle);
+	if (session == nullptr) {
+		return nullptr;
+	}
+
+	if (SSL_SESSION_is_resumable(session) == 0) {
+		SSL_SESSION_free(session);
+		return nullptr;
+	}
+
+	return { session, &SSL_SESSION_free };
+}
+
+void Jupiter::SecureSocket::setSession(Session in_session) {
+	m_ssl_data->session = std::move(in_session);
+}
+
+bool Jupiter::SecureSocket::isSessionReused() const {
+	return m_ssl_data->handle != nullptr && SSL_session_reused(m_ssl_data->handle) == 1;
+}
+
+void Jupiter::SecureSocket::setKernelTLS(bool in_enabled) {
+	m_ssl_data->kernel_tls = in_enabled;
+}
+
+Jupiter::SecureSocket::KernelTLS Jupiter::SecureSocket::getKernelTLS() const {
+	if (!m_ssl_data->kernel_tls) {
+		return KernelTLS::DISABLED;
+	}
+
+#if defined JUPITER_KTLS
+	SSL* handle = m_ssl_data->handle;
+	if (handle == nullptr || SSL_is_init_finished(handle) != 1) {
+		return KernelTLS::PENDING;
+	}
+
+	bool send = is_kernel_tls_send(handle);
+	bool recv = BIO_get_ktls_recv(SSL_get_rbio(handle));
+	if (send) {
+		return recv ? KernelTLS::SEND_RECV : KernelTLS::SEND;
+	}
+	return recv ? KernelTLS::RECV : KernelTLS::DECLINED;
+#else // JUPITER_KTLS
+	return KernelTLS::UNSUPPORTED;
+#endif // JUPITER_KTLS
+}
+
+const char *Jupiter::SecureSocket::getCipherName() const {
+	return SSL_CIPHER_get_name(SSL_get_current_cipher(m_ssl_data->handle));
+}
+
 void Jupiter::SecureSocket::setCertificate(std::string cert, std::string key) {
 	m_ssl_data->cert = std::move(cert);
 	m_ssl_data->key = std::move(key);
@@ -146,59 +537,182 @@ bool Jupiter::SecureSocket::connect(const char *hostname, unsigned short iPort,
 	return Jupiter::Socket::connect(hostname, iPort, clientAddress, clientPort) && this->initSSL();
 }
 
+int Jupiter::SecureSocket::continueConnect() {
+	if (m_ssl_data->handle == nullptr) {
+		// The handshake shares the deadline of the connection in progress; a socket which was already connected (i.e: STARTTLS) gets a full connect timeout
+		auto deadline = this->getConnectDeadline();
+		if (deadline == std::chrono::steady_clock::time_point::max()) {
+			deadline = std::chrono::steady_clock::now() + this->getConnectTimeout();
+		}
+
+		int result = Jupiter::Socket::continueConnect();
+		if (result <= 0) {
+			return result;
+		}
+
+		if (!initClientHandle()) {
+			return -1;
+		}
+
+		m_ssl_data->handshake_deadline = deadline;
+	}
+
+	int result = handshake();
+	if (result == 0 && std::chrono::steady_clock::now() >= m_ssl_data->handshake_deadline) {
+		set_last_error(ETIMEDOUT);
+		return -1;
+	}
+
+	return result;
+}
+
 int Jupiter::SecureSocket::peek() {
 	if (m_ssl_data->handle == nullptr)
 		return -1;
 	Jupiter::Socket::Buffer &buffer = this->getInternalBuffer();
 	buffer.clear();
 	int r = SSL_peek(m_ssl_data->handle, buffer.data(), static_cast<int>(this->getBufferSize()));
-	if (r > 0)
-		buffer.set_length(r);
+	if (r <= 0)
+		return handle_ssl_error(m_ssl_data->handle, r, m_ssl_data->io_wait);
+	buffer.set_length(r);
+	m_ssl_data->io_wait = IOWait::NONE;
 	return r;
 }
 
 int Jupiter::SecureSocket::recv() {
 	if (m_ssl_data->handle == nullptr)
 		return -1;
-	Jupiter::Socket::Buffer &buffer = this->getInternalBuffer();
-	buffer.clear();
-	int r = SSL_read(m_ssl_data->handle, buffer.data(), static_cast<int>(this->getBufferSize()));
-	if (r > 0)
-		buffer.set_length(r);
+	std::span<char> space = this->prepareReceive();
+	int r = SSL_read(m_ssl_data->handle, space.data(), static_cast<int>(std::min<size_t>(space.size(), INT_MAX)));
+	if (r <= 0)
+		return handle_ssl_error(m_ssl_data->handle, r, m_ssl_data->io_wait);
+	this->getInternalBuffer().commit(r);
+	m_ssl_data->io_wait = IOWait::NONE;
 	return r;
 }
 
 int Jupiter::SecureSocket::send(const char *data, size_t datalen) {
-	return SSL_write(m_ssl_data->handle, data, static_cast<int>(datalen));
+	int r = SSL_write(m_ssl_data->handle, data, static_cast<int>(datalen));
+	if (r <= 0)
+		return handle_ssl_error(m_ssl_data->handle, r, m_ssl_data->io_wait);
+	m_ssl_data->io_wait = IOWait::NONE;
+	return r;
+}
+
+int Jupiter::SecureSocket::sendv(std::span<const std::string_view> in_buffers) {
+	// Small buffers are copied together, so that each doesn't become a record (and packet) of its own
+	char record[s_max_record_size];
+	int total_sent = 0;
+	size_t index = 0;
+	size_t offset = 0; // Start of the unsent data within in_buffers[index]
+	while (index != in_buffers.size()) {
+		std::string_view data = in_buffers[index].substr(offset);
+		if (data.size() >= sizeof(record)) {
+			// Fills a record by itself; no need to copy
+			data = data.substr(0, INT_MAX);
+			offset += data.size();
+			if (offset == in_buffers[index].size()) {
+				++index;
+				offset = 0;
+			}
+		}
+		else {
+			size_t record_size = 0;
+			while (index != in_buffers.size() && record_size != sizeof(record)) {
+				std::string_view piece = in_buffers[index].substr(offset);
+				size_t count = std::min(piece.size(), sizeof(record) - record_size);
+				if (count != 0) {
+					std::memcpy(record + record_size, piece.data(), count);
+					record_size += count;
+				}
+				offset += count;
+				if (offset == in_buffers[index].size()) {
+					++index;
+					offset = 0;
+				}
+			}
+			data = { record, record_size };
+		}
+
+		if (data.empty()) {
+			break;
+		}
+
+		int sent = SSL_write(m_ssl_data->handle, data.data(), static_cast<int>(data.size()));
+		if (sent <= 0) {
+			// Report what was sent so far, if anything
+			int result = handle_ssl_error(m_ssl_data->handle, sent, m_ssl_data->io_wait);
+			return total_sent == 0 ? result : total_sent;
+		}
+		m_ssl_data->io_wait = IOWait::NONE;
+
+		total_sent += sent;
+		if (static_cast<size_t>(sent) != data.size()) {
+			break;
+		}
+	}
+
+	return total_sent;
+}
+
+int Jupiter::SecureSocket::sendFile(int in_fd, uint64_t in_offset, size_t in_count) {
+#if defined JUPITER_KTLS
+	if (is_kernel_tls_send(m_ssl_data->handle)) {
+		// The kernel encrypts the file as it's sent, so it never passes through user space
+		in_count = std::min<size_t>(in_count, INT_MAX);
+		ossl_ssize_t result = SSL_sendfile(m_ssl_data->handle, in_fd, static_cast<off_t>(in_offset), in_count, 0);
+		if (result <= 0) {
+			return handle_ssl_error(m_ssl_data->handle, static_cast<int>(result), m_ssl_data->io_wait);
+		}
+		m_ssl_data->io_wait = IOWait::NONE;
+		return static_cast<int>(result);
+	}
+#endif // JUPITER_KTLS
+
+	return sendFileBuffered(in_fd, in_offset, in_count);
 }
 
 bool Jupiter::SecureSocket::initSSL() {
-	SSL_load_error_strings();
-	SSL_library_init();
+	if (!initClientHandle()) {
+		return false;
+	}
 
-	if (m_ssl_data->context == nullptr) {
+	int t = SSL_connect(m_ssl_data->handle);
+	if (t != 1)
+	{
+		ERR_print_errors_fp(stderr);
+		return false;
+	}
+	return true;
+}
+
+// Creates the client-side handle for a connected socket; the handshake is left to the caller
+bool Jupiter::SecureSocket::initClientHandle() {
+	// Sockets reused across connections (i.e: IRC reconnects) pick up a context rebuilt by a rehash, like listeners do in accept()
+	if (m_ssl_data->context == nullptr || SSLContextRegistry::instance().generation() != m_ssl_data->context_generation) {
 		if (m_ssl_data->method == nullptr) {
 			m_ssl_data->method = TLS_method();
 			if (m_ssl_data->method == nullptr)
 				return false;
 		}
 
-		m_ssl_data->context = SSL_CTX_new(m_ssl_data->method);
-		if (m_ssl_data->context == nullptr) {
-			ERR_print_errors_fp(stderr);
-			return false;
+		auto context = SSLContextRegistry::instance().get({ m_ssl_data->method, false, m_ssl_data->cert, m_ssl_data->key }, m_ssl_data->context_generation);
+		if (context != nullptr) {
+			m_ssl_data->context = std::move(context);
 		}
-		if (!m_ssl_data->cert.empty()) {
-			loadCertificate(m_ssl_data->context, m_ssl_data->cert.c_str(), m_ssl_data->key.c_str());
+		else if (m_ssl_data->context == nullptr) {
+			return false;
 		}
 	}
 
-	m_ssl_data->handle = SSL_new(m_ssl_data->context);
+	m_ssl_data->handle = SSL_new(m_ssl_data->context.get());
 	if (m_ssl_data->handle == nullptr) {
 		ERR_print_errors_fp(stderr);
 		return false;
 	}
 
+	request_kernel_tls(m_ssl_data->handle, m_ssl_data->kernel_tls);
+
 	// Not suppressing this warning; descriptor ideally shouldn't be getting shortened here, even if it's "safe"
 	// TODO: Can't resolve this without removing OpenSSL usage on Windows; we should ideally use Windows APIs
 	if (SSL_set_fd(m_ssl_data->handle, this->getDescriptor()) == 0) {
@@ -210,11 +724,11 @@ bool Jupiter::SecureSocket::initSSL() {
 		ERR_print_errors_fp(stderr);
 		return false;
 	}
-	int t = SSL_connect(m_ssl_data->handle);
-	if (t != 1)
-	{
-		ERR_print_errors_fp(stderr);
-		return false;
+	if (m_ssl_data->session != nullptr
+		&& SSL_set_session(m_ssl_data->handle, m_ssl_data->session.get()) != 1) {
+		// Not fatal; a full handshake is performed instead
+		ERR_clear_error();
 	}
+	SSL_set_connect_state(m_ssl_data->handle);
 	return true;
 }
\ No newline at end of file
@@ -17,27 +17,44 @@
  */
 
 #include <cstdio>
+#include <algorithm>
+#include <climits>
+#include <future>
+#include <memory>
+#include <system_error>
+#include <type_traits>
+#include <vector>
 
 #if defined _WIN32
 #include <WinSock2.h>
 #include <ws2tcpip.h>
+#include <io.h>
 #pragma comment(lib, "Ws2_32.lib")
 bool socketInit = false;
 #else // _WIN32
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <cstring>
 #include <unistd.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <sys/uio.h>
+#include <poll.h>
+#if defined __linux__
+#include <sys/sendfile.h>
+#endif // __linux__
 #define INVALID_SOCKET (Jupiter::Socket::SocketType)(~0)
 #define SOCKET_ERROR (-1)
 #endif // _WIN32
 
 #include "Socket.h"
+#include "Resolver.h"
 #include "Functions.h"
+#include "Readable_String.h" // from_string
 
 /** Narrowing conversions; I just don't want to explicitly static_cast parameters to methods that might vary by platform */
 #if defined _MSC_VER
@@ -46,11 +63,18 @@ bool socketInit = false;
 #endif
 
 constexpr size_t s_initial_buffer_size = 512;
+constexpr size_t s_max_send_buffers = 64; // Maximum number of buffers passed to the kernel in one sendv() call
+constexpr size_t s_send_file_buffer_size = 16384; // Buffer size used by sendFileBuffered(); matches the maximum TLS record size
+constexpr size_t s_min_receive_space = 512; // Least room recv() makes after data retained in the buffer
+constexpr std::chrono::milliseconds s_default_connection_attempt_delay{ 250 }; // RFC 8305 recommended "Connection Attempt Delay"
+constexpr std::chrono::milliseconds s_default_connect_timeout{ 30000 };
+constexpr int s_default_fast_open_queue_length = 256; // Used when Options::fast_open_queue_length is unset
 
 Jupiter::Socket::Buffer::Buffer()
 	: m_buffer{ ::operator new(s_initial_buffer_size) },
 	m_buffer_capacity{ s_initial_buffer_size },
-	m_buffer_size{0} {
+	m_buffer_offset{ 0 },
+	m_buffer_size{ 0 } {
 }
 
 Jupiter::Socket::Buffer::~Buffer() {
@@ -76,41 +100,261 @@ void Jupiter::Socket::Buffer::reserve(size_t new_capacity) {
 		return;
 	}
 
-	// We're gonna change the buffer one way or another; update our capacity
+	// Move the data to the front of the new buffer; consumed space isn't carried over
+	void* new_buffer = ::operator new(new_capacity);
+	if (m_buffer_size != 0) {
+		std::memcpy(new_buffer, chr_data(), m_buffer_size);
+	}
+
+	::operator delete(m_buffer);
+	m_buffer = new_buffer;
 	m_buffer_capacity = new_capacity;
+	m_buffer_offset = 0;
+}
+
+void Jupiter::Socket::Buffer::clear() {
+	m_buffer_offset = 0;
+	m_buffer_size = 0;
+}
 
-	if (m_buffer_size == 0) {
-		// Nothing to copy; easy mode
-		::operator delete(m_buffer);
-		m_buffer = ::operator new(new_capacity);
+void Jupiter::Socket::Buffer::consume(size_t in_count) {
+	if (in_count >= m_buffer_size) {
+		clear();
 		return;
 	}
 
-	// Backup current buffer data
-	void* old_buffer = m_buffer;
+	m_buffer_offset += in_count;
+	m_buffer_size -= in_count;
+}
 
-	// Create new buffer
-	m_buffer = ::operator new(new_capacity);
-	std::memcpy(m_buffer, old_buffer, m_buffer_size);
+char* Jupiter::Socket::Buffer::prepare(size_t in_min_free) {
+	if (free_space() < in_min_free) {
+		if (m_buffer_capacity - m_buffer_size >= in_min_free) {
+			// Reclaim consumed space
+			std::memmove(m_buffer, chr_data(), m_buffer_size);
+			m_buffer_offset = 0;
+		}
+		else {
+			reserve(std::max(m_buffer_capacity * 2, m_buffer_size + in_min_free));
+		}
+	}
 
-	// Nuke the old buffer
-	::operator delete(m_buffer);
+	return chr_data() + m_buffer_size;
 }
 
-void Jupiter::Socket::Buffer::clear() {
-	m_buffer_size = 0;
+size_t Jupiter::Socket::Buffer::free_space() const {
+	return m_buffer_capacity - m_buffer_offset - m_buffer_size;
+}
+
+void Jupiter::Socket::Buffer::commit(size_t in_count) {
+	m_buffer_size += in_count;
 }
 
 std::string_view Jupiter::Socket::Buffer::view() const {
-	return { static_cast<char*>(m_buffer), m_buffer_size };
+	return { chr_data(), m_buffer_size };
 }
 
 void* Jupiter::Socket::Buffer::data() const {
-	return m_buffer;
+	return chr_data();
 }
 
 char* Jupiter::Socket::Buffer::chr_data() const {
-	return static_cast<char*>(m_buffer);
+	return static_cast<char*>(m_buffer) + m_buffer_offset;
+}
+
+static void close_descriptor(Jupiter::Socket::SocketType in_descriptor) {
+#if defined _WIN32
+	::closesocket(in_descriptor);
+#else // _WIN32
+	::close(in_descriptor);
+#endif // _WIN32
+}
+
+static void set_last_error(int in_error) {
+#if defined _WIN32
+	WSASetLastError(in_error);
+#else // _WIN32
+	errno = in_error;
+#endif // _WIN32
+}
+
+static int poll_descriptors(pollfd *in_descriptors, size_t in_count, int in_timeout) {
+#if defined _WIN32
+	return WSAPoll(in_descriptors, static_cast<ULONG>(in_count), in_timeout);
+#else // _WIN32
+	return ::poll(in_descriptors, in_count, in_timeout);
+#endif // _WIN32
+}
+
+template<typename T>
+static bool set_socket_option(Jupiter::Socket::SocketType in_descriptor, int in_level, int in_name, T in_value) {
+	return setsockopt(in_descriptor, in_level, in_name, reinterpret_cast<const char *>(&in_value), sizeof(in_value)) == 0;
+}
+
+// Applies tuning options to a socket; listeners and connecting sockets enable fast open differently
+static bool apply_options(Jupiter::Socket::SocketType in_descriptor, const Jupiter::Socket::Options &in_options, int in_type, bool in_listener) {
+	bool result = true;
+	if (in_options.receive_buffer_size) {
+		result &= set_socket_option(in_descriptor, SOL_SOCKET, SO_RCVBUF, *in_options.receive_buffer_size);
+	}
+	if (in_options.send_buffer_size) {
+		result &= set_socket_option(in_descriptor, SOL_SOCKET, SO_SNDBUF, *in_options.send_buffer_size);
+	}
+	if (in_options.keep_alive) {
+		result &= set_socket_option(in_descriptor, SOL_SOCKET, SO_KEEPALIVE, static_cast<int>(*in_options.keep_alive));
+	}
+#if defined SO_BUSY_POLL
+	if (in_options.busy_poll) {
+		result &= set_socket_option(in_descriptor, SOL_SOCKET, SO_BUSY_POLL, static_cast<int>(in_options.busy_poll->count()));
+	}
+#endif // SO_BUSY_POLL
+
+	if (in_type != SOCK_STREAM) {
+		return result;
+	}
+
+	if (in_options.no_delay) {
+		result &= set_socket_option(in_descriptor, IPPROTO_TCP, TCP_NODELAY, static_cast<int>(*in_options.no_delay));
+	}
+#if defined TCP_KEEPIDLE
+	if (in_options.keep_alive_idle) {
+		result &= set_socket_option(in_descriptor, IPPROTO_TCP, TCP_KEEPIDLE, static_cast<int>(in_options.keep_alive_idle->count()));
+	}
+#endif // TCP_KEEPIDLE
+#if defined TCP_KEEPINTVL
+	if (in_options.keep_alive_interval) {
+		result &= set_socket_option(in_descriptor, IPPROTO_TCP, TCP_KEEPINTVL, static_cast<int>(in_options.keep_alive_interval->count()));
+	}
+#endif // TCP_KEEPINTVL
+#if defined TCP_KEEPCNT
+	if (in_options.keep_alive_count) {
+		result &= set_socket_option(in_descriptor, IPPROTO_TCP, TCP_KEEPCNT, *in_options.keep_alive_count);
+	}
+#endif // TCP_KEEPCNT
+
+	if (in_options.fast_open) {
+		if (in_listener) {
+#if defined TCP_FASTOPEN
+			result &= set_socket_option(in_descriptor, IPPROTO_TCP, TCP_FASTOPEN, *in_options.fast_open ? in_options.fast_open_queue_length.value_or(s_default_fast_open_queue_length) : 0);
+#endif // TCP_FASTOPEN
+		}
+		else {
+#if defined TCP_FASTOPEN_CONNECT
+			// connect() is deferred until the first send, which then carries data in the SYN once a cookie is cached
+			result &= set_socket_option(in_descriptor, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, static_cast<int>(*in_options.fast_open));
+#endif // TCP_FASTOPEN_CONNECT
+		}
+	}
+
+	return result;
+}
+
+/** State of a connection started by startConnect() */
+struct PendingConnect {
+	std::shared_future<Jupiter::Resolver::Addresses> remote_addresses;
+	std::shared_future<Jupiter::Resolver::Addresses> local_addresses; // Only valid when a client address is specified
+	std::string remote_port;
+	std::string local_port;
+	addrinfo *remote = nullptr; // Set once resolved
+	addrinfo *local = nullptr;
+	bool resolved = false;
+	bool bind_local = false;
+	std::vector<const addrinfo *> candidates; // Resolved addresses, interleaved by family
+	size_t next_candidate = 0;
+	std::vector<pollfd> attempts; // Connection attempts in progress
+	Jupiter::Socket::Options options; // Applied to each attempt
+	std::chrono::steady_clock::time_point next_attempt_time;
+	std::chrono::steady_clock::time_point deadline;
+
+	~PendingConnect() {
+		for (const pollfd &attempt : attempts) {
+			close_descriptor(attempt.fd);
+		}
+
+		Jupiter::Resolver::freeAddrInfo(remote);
+		Jupiter::Resolver::freeAddrInfo(local);
+	}
+};
+
+// Orders addresses per RFC 8305 section 4: alternating families, starting with the family of the most preferred address
+static std::vector<const addrinfo *> interleave_addresses(const addrinfo *in_addresses) {
+	std::vector<const addrinfo *> preferred;
+	std::vector<const addrinfo *> other;
+	for (const addrinfo *address = in_addresses; address != nullptr; address = address->ai_next) {
+		if (address->ai_family == in_addresses->ai_family) {
+			preferred.push_back(address);
+		}
+		else {
+			other.push_back(address);
+		}
+	}
+
+	std::vector<const addrinfo *> result;
+	result.reserve(preferred.size() + other.size());
+	for (size_t index = 0; index != std::max(preferred.size(), other.size()); ++index) {
+		if (index < preferred.size()) {
+			result.push_back(preferred[index]);
+		}
+		if (index < other.size()) {
+			result.push_back(other[index]);
+		}
+	}
+	return result;
+}
+
+// Starts a non-blocking connection attempt to an address, binding to a local address of the same family if any are specified
+static Jupiter::Socket::SocketType start_connect_attempt(const addrinfo *in_address, const addrinfo *in_local, bool in_bind_local, int in_type, int in_protocol, bool in_reuse_port, const Jupiter::Socket::Options &in_options) {
+	if (in_bind_local) {
+		while (in_local != nullptr && in_local->ai_family != in_address->ai_family) {
+			in_local = in_local->ai_next;
+		}
+
+		if (in_local == nullptr) {
+			return INVALID_SOCKET;
+		}
+	}
+
+	Jupiter::Socket::SocketType descriptor = socket(in_address->ai_family, in_type, in_protocol);
+	if (descriptor == INVALID_SOCKET) {
+		return INVALID_SOCKET;
+	}
+
+#if defined _WIN32
+	unsigned long block_mode = 1;
+	ioctlsocket(descriptor, FIONBIO, &block_mode);
+#else // _WIN32
+	fcntl(descriptor, F_SETFL, fcntl(descriptor, F_GETFL, 0) | O_NONBLOCK);
+#endif // _WIN32
+
+	apply_options(descriptor, in_options, in_type, false);
+
+	if (in_bind_local) {
+#if defined SO_REUSEPORT
+		if (in_reuse_port) {
+			int option_value = 1;
+			setsockopt(descriptor, SOL_SOCKET, SO_REUSEPORT, &option_value, sizeof(option_value));
+		}
+#endif // SO_REUSEPORT
+
+		if (::bind(descriptor, in_local->ai_addr, in_local->ai_addrlen) == SOCKET_ERROR) {
+			close_descriptor(descriptor);
+			return INVALID_SOCKET;
+		}
+	}
+
+	if (::connect(descriptor, in_address->ai_addr, in_address->ai_addrlen) == SOCKET_ERROR) {
+#if defined _WIN32
+		bool in_progress = WSAGetLastError() == WSAEWOULDBLOCK;
+#else // _WIN32
+		bool in_progress = errno == EINPROGRESS;
+#endif // _WIN32
+		if (!in_progress) {
+			close_descriptor(descriptor);
+			return INVALID_SOCKET;
+		}
+	}
+
+	return descriptor;
 }
 
 struct Jupiter::Socket::Data {
@@ -118,11 +362,19 @@ struct Jupiter::Socket::Data {
 	SocketType rawSock = INVALID_SOCKET;
 	unsigned short remote_port = 0;
 	unsigned short bound_port = 0;
-	std::string remote_host;
+	std::string remote_host; // Formatted from remote_address on first use, for accepted sockets
 	std::string bound_host;
+	sockaddr_storage remote_address{};
+	socklen_t remote_address_size = 0; // Non-zero while remote_address has yet to be formatted into remote_host
 	int sockType = SOCK_RAW;
 	int sockProto = IPPROTO_RAW;
 	bool is_shutdown = false;
+	bool reuse_port = false;
+	bool retain_buffer = false; // Whether recv() appends to unconsumed data
+	std::chrono::milliseconds connect_timeout = s_default_connect_timeout;
+	std::chrono::milliseconds connection_attempt_delay = s_default_connection_attempt_delay;
+	Jupiter::Socket::Options options; // Applied to sockets as they're created
+	std::unique_ptr<PendingConnect> pending_connect; // Set while a connection started by startConnect() is in progress
 #if defined _WIN32
 	unsigned long blockMode = 0;
 #endif
@@ -143,6 +395,13 @@ Jupiter::Socket::Data::Data(const Data &source) {
 	Jupiter::Socket::Data::sockProto = source.sockProto;
 	Jupiter::Socket::Data::remote_host = source.remote_host;
 	Jupiter::Socket::Data::bound_host = source.bound_host;
+	Jupiter::Socket::Data::remote_address = source.remote_address;
+	Jupiter::Socket::Data::remote_address_size = source.remote_address_size;
+	Jupiter::Socket::Data::reuse_port = source.reuse_port;
+	Jupiter::Socket::Data::retain_buffer = source.retain_buffer;
+	Jupiter::Socket::Data::connect_timeout = source.connect_timeout;
+	Jupiter::Socket::Data::connection_attempt_delay = source.connection_attempt_delay;
+	Jupiter::Socket::Data::options = source.options;
 #if defined _WIN32
 	Jupiter::Socket::Data::blockMode = source.blockMode;
 #endif
@@ -198,7 +457,10 @@ bool Jupiter::Socket::connect(addrinfo *info) {
 #endif // _WIN32
 
 	m_data->rawSock = socket(info->ai_family, m_data->sockType, m_data->sockProto);
-	
+	if (m_data->rawSock != INVALID_SOCKET) {
+		apply_options(m_data->rawSock, m_data->options, m_data->sockType, false);
+	}
+
 	if (m_data->rawSock == INVALID_SOCKET
 		|| (m_data->sockType != SOCK_RAW && m_data->sockProto != IPPROTO_RAW && ::connect(m_data->rawSock, info->ai_addr, info->ai_addrlen) == SOCKET_ERROR))
 		return false;
@@ -207,46 +469,194 @@ bool Jupiter::Socket::connect(addrinfo *info) {
 }
 
 bool Jupiter::Socket::connect(const char *hostname, unsigned short iPort, const char *clientAddress, unsigned short clientPort) {
+	if (!Jupiter::Socket::startConnect(hostname, iPort, clientAddress, clientPort)) {
+		return false;
+	}
+
+	int result;
+	while ((result = Jupiter::Socket::continueConnect()) == 0) {
+		// Sleep until something may have changed: resolution finishing, an attempt completing, or the next attempt being due
+		PendingConnect &pending = *m_data->pending_connect;
+		auto now = std::chrono::steady_clock::now();
+		if (!pending.resolved) {
+			if (pending.remote_addresses.wait_until(pending.deadline) == std::future_status::ready && pending.bind_local) {
+				pending.local_addresses.wait_until(pending.deadline);
+			}
+			continue;
+		}
+
+		auto wake_time = pending.deadline;
+		if (pending.next_candidate < pending.candidates.size()) {
+			wake_time = std::min(wake_time, pending.next_attempt_time);
+		}
+
+		auto timeout = std::chrono::ceil<std::chrono::milliseconds>(wake_time - now);
+		poll_descriptors(pending.attempts.data(), pending.attempts.size(), static_cast<int>(std::max<std::chrono::milliseconds::rep>(timeout.count(), 0)));
+	}
+
+	return result > 0 && Jupiter::Socket::setBlocking(true);
+}
+
+bool Jupiter::Socket::startConnect(const char *hostname, unsigned short iPort, const char *clientAddress, unsigned short clientPort) {
 #if defined _WIN32
 	if (!socketInit && !Jupiter::Socket::init())
 		return false;
 #endif // _WIN32
 	m_data->remote_host = hostname;
 	m_data->remote_port = iPort;
-	addrinfo *info_head = Jupiter::Socket::getAddrInfo(m_data->remote_host.c_str(), std::to_string(m_data->remote_port).c_str());
-	if (info_head != nullptr) {
-		addrinfo *info = info_head;
-		do {
-			if (clientAddress != nullptr) {
-				// bind will initialize our socket
-				if (Jupiter::Socket::bind(clientAddress, clientPort, false) == false)
-					break;
+	m_data->remote_address_size = 0;
+	if (clientAddress != nullptr) {
+		m_data->bound_host = clientAddress;
+		m_data->bound_port = clientPort;
+	}
+
+	auto pending = std::make_unique<PendingConnect>();
+	pending->bind_local = clientAddress != nullptr;
+	pending->deadline = std::chrono::steady_clock::now() + m_data->connect_timeout;
+	pending->remote_port = std::to_string(iPort);
+	pending->local_port = std::to_string(clientPort);
+
+	// Resolved in the background (or from cache), so that a slow or unreachable DNS server never blocks the caller
+	try {
+		pending->remote_addresses = Jupiter::Resolver::instance().resolve(m_data->remote_host);
+		if (pending->bind_local) {
+			pending->local_addresses = Jupiter::Resolver::instance().resolve(clientAddress);
+		}
+	}
+	catch (const std::system_error &) {
+		return false;
+	}
+
+	m_data->pending_connect = std::move(pending);
+	return true;
+}
+
+int Jupiter::Socket::continueConnect() {
+	PendingConnect *pending = m_data->pending_connect.get();
+	if (pending == nullptr) {
+		// Nothing in progress; report the outcome of the last connection
+		return m_data->rawSock != INVALID_SOCKET && m_data->rawSock != 0 ? 1 : -1;
+	}
+
+	auto fail = [this](int in_error) {
+		m_data->pending_connect.reset();
+		m_data->rawSock = INVALID_SOCKET;
+		set_last_error(in_error);
+		return -1;
+	};
+
+	auto now = std::chrono::steady_clock::now();
+	if (!pending->resolved) {
+		if (pending->remote_addresses.wait_for(std::chrono::seconds::zero()) != std::future_status::ready
+			|| (pending->bind_local && pending->local_addresses.wait_for(std::chrono::seconds::zero()) != std::future_status::ready)) {
+			return now < pending->deadline ? 0 : fail(ETIMEDOUT);
+		}
+
+		addrinfo hints{};
+		hints.ai_socktype = m_data->sockType;
+		pending->remote = Jupiter::Resolver::makeAddrInfo(pending->remote_addresses.get(), pending->remote_port.c_str(), &hints);
+		if (pending->bind_local) {
+			hints.ai_flags = AI_PASSIVE;
+			pending->local = Jupiter::Resolver::makeAddrInfo(pending->local_addresses.get(), pending->local_port.c_str(), &hints);
+		}
+
+		pending->resolved = true;
+		if (pending->remote == nullptr) {
+			return fail(EHOSTUNREACH);
+		}
+
+		pending->candidates = interleave_addresses(pending->remote);
+		pending->next_attempt_time = now;
+
+		// Fast open reports an attempt as connected before its SYN is even sent, so the first would always win
+		pending->options = m_data->options;
+		if (pending->candidates.size() > 1) {
+			pending->options.fast_open.reset();
+		}
+	}
+
+	const addrinfo *local = pending->local;
+	int last_error = ECONNREFUSED;
+	bool attempt_failed;
+	do {
+		attempt_failed = false;
+
+		// Start the next attempt once it is due, or right away if there are none in progress
+		while (pending->next_candidate < pending->candidates.size()
+			&& (pending->attempts.empty() || now >= pending->next_attempt_time)) {
+			const addrinfo *candidate = pending->candidates[pending->next_candidate++];
+			SocketType descriptor = start_connect_attempt(candidate, local, pending->bind_local, m_data->sockType, m_data->sockProto, m_data->reuse_port, pending->options);
+			if (descriptor != INVALID_SOCKET) {
+				pending->attempts.push_back({ descriptor, POLLOUT, 0 });
+				pending->next_attempt_time = now + m_data->connection_attempt_delay;
+				break;
 			}
-			else {
-				m_data->rawSock = socket(info->ai_family, m_data->sockType, m_data->sockProto);
-				if (m_data->rawSock == INVALID_SOCKET) {
-					info = info->ai_next;
-					continue;
-				}
+		}
+
+		if (pending->attempts.empty()) {
+			return fail(last_error);
+		}
+
+		if (poll_descriptors(pending->attempts.data(), pending->attempts.size(), 0) <= 0) {
+			break;
+		}
+
+		for (auto itr = pending->attempts.begin(); itr != pending->attempts.end();) {
+			if (itr->revents == 0) {
+				++itr;
+				continue;
 			}
 
-			if (::connect(m_data->rawSock, info->ai_addr, info->ai_addrlen) == SOCKET_ERROR) {
+			int error = 0;
+			socklen_t error_size = sizeof(error);
+			getsockopt(itr->fd, SOL_SOCKET, SO_ERROR, reinterpret_cast<char *>(&error), &error_size);
+			if (error == 0) {
+				// Connected; keep this attempt, and let PendingConnect close the rest
+				m_data->rawSock = itr->fd;
+				m_data->is_shutdown = false;
 #if defined _WIN32
-				::closesocket(m_data->rawSock);
-#else // _WIN32
-				::close(m_data->rawSock);
-#endif // WIN32
-				m_data->rawSock = INVALID_SOCKET;
-				info = info->ai_next;
-				continue;
+				m_data->blockMode = 1;
+#endif // _WIN32
+				pending->attempts.erase(itr);
+				m_data->pending_connect.reset();
+				return 1;
 			}
 
-			Jupiter::Socket::freeAddrInfo(info_head);
-			return true;
-		} while (info != nullptr);
-		Jupiter::Socket::freeAddrInfo(info_head);
+			close_descriptor(itr->fd);
+			itr = pending->attempts.erase(itr);
+			last_error = error;
+			attempt_failed = true;
+		}
+
+		// A failed attempt makes way for the next immediately
+		pending->next_attempt_time = now;
+	} while (attempt_failed);
+
+	return now < pending->deadline ? 0 : fail(ETIMEDOUT);
+}
+
+void Jupiter::Socket::setConnectTimeout(std::chrono::milliseconds in_timeout) {
+	m_data->connect_timeout = in_timeout;
+}
+
+std::chrono::milliseconds Jupiter::Socket::getConnectTimeout() const {
+	return m_data->connect_timeout;
+}
+
+void Jupiter::Socket::setConnectionAttemptDelay(std::chrono::milliseconds in_delay) {
+	m_data->connection_attempt_delay = in_delay;
+}
+
+std::chrono::milliseconds Jupiter::Socket::getConnectionAttemptDelay() const {
+	return m_data->connection_attempt_delay;
+}
+
+std::chrono::steady_clock::time_point Jupiter::Socket::getConnectDeadline() const {
+	if (m_data->pending_connect == nullptr) {
+		return std::chrono::steady_clock::time_point::max();
 	}
-	return false;
+
+	return m_data->pending_connect->deadline;
 }
 
 bool Jupiter::Socket::bind(const char *hostname, unsigned short iPort, bool andListen) {
@@ -267,6 +677,15 @@ bool Jupiter::Socket::bind(const char *hostname, unsigned short iPort, bool andL
 				continue;
 			}
 
+			apply_options(m_data->rawSock, m_data->options, m_data->sockType, andListen);
+
+#if defined SO_REUSEPORT
+			if (m_data->reuse_port) {
+				int option_value = 1;
+				setsockopt(m_data->rawSock, SOL_SOCKET, SO_REUSEPORT, &option_value, sizeof(option_value));
+			}
+#endif // SO_REUSEPORT
+
 			if (::bind(m_data->rawSock, info->ai_addr, info->ai_addrlen) == SOCKET_ERROR) {
 #if defined _WIN32
 				::closesocket(m_data->rawSock);
@@ -299,6 +718,7 @@ void Jupiter::Socket::shutdown() {
 
 void Jupiter::Socket::close() {
 	if (m_data != nullptr) {
+		m_data->pending_connect.reset();
 		if (m_data->is_shutdown == false)
 			this->shutdown();
 #if defined _WIN32
@@ -315,13 +735,11 @@ bool Jupiter::Socket::isShutdown() const {
 }
 
 addrinfo* Jupiter::Socket::getAddrInfo(const char *hostname, const char *port) { // static
-	addrinfo *ptr{};
-	getaddrinfo(hostname, port, nullptr, &ptr);
-	return ptr;
+	return Jupiter::Resolver::instance().getAddrInfo(hostname, port);
 }
 
 void Jupiter::Socket::freeAddrInfo(addrinfo *info) { // static
-	freeaddrinfo(info);
+	Jupiter::Resolver::freeAddrInfo(info);
 }
 
 addrinfo *Jupiter::Socket::getAddrInfo(addrinfo *addr, unsigned int result) { // static
@@ -355,7 +773,9 @@ std::string Jupiter::Socket::resolveAddress(const char *hostname, unsigned int r
 		return {};
 	};
 
-	return Jupiter::Socket::resolveAddress(info, result);
+	std::string address = Jupiter::Socket::resolveAddress(info, result);
+	Jupiter::Socket::freeAddrInfo(info);
+	return address;
 }
 
 std::string Jupiter::Socket::resolveHostname(addrinfo *addr) { // static
@@ -379,7 +799,9 @@ std::string Jupiter::Socket::resolveHostname(const char *hostname, unsigned int
 		return {};
 	}
 
-	return Jupiter::Socket::resolveHostname(info, result);
+	std::string resolved = Jupiter::Socket::resolveHostname(info, result);
+	Jupiter::Socket::freeAddrInfo(info);
+	return resolved;
 }
 
 uint32_t Jupiter::Socket::pton4(const char *str) {
@@ -423,25 +845,138 @@ std::string Jupiter::Socket::ntop(void *ip, size_t size) {
 	}
 }
 
+void Jupiter::Socket::setReusePort(bool in_reuse_port) {
+	m_data->reuse_port = in_reuse_port;
+}
+
+Jupiter::Socket::Options Jupiter::Socket::Options::read(const std::function<std::string_view(std::string_view key)> &in_lookup) { // static
+	auto read_option = [&in_lookup]<typename T>(std::string_view key, std::optional<T> &out_option) {
+		std::string_view value = in_lookup(key);
+		if (value.empty()) {
+			return;
+		}
+
+		if constexpr (std::is_same_v<T, bool>) {
+			out_option = Jupiter::from_string<bool>(value);
+		}
+		else {
+			out_option = T(Jupiter::from_string<int>(value));
+		}
+	};
+
+	Options result;
+	read_option("TCPNoDelay", result.no_delay);
+	read_option("ReceiveBufferSize", result.receive_buffer_size);
+	read_option("SendBufferSize", result.send_buffer_size);
+	read_option("KeepAlive", result.keep_alive);
+	read_option("KeepAliveIdle", result.keep_alive_idle);
+	read_option("KeepAliveInterval", result.keep_alive_interval);
+	read_option("KeepAliveCount", result.keep_alive_count);
+	read_option("TCPFastOpen", result.fast_open);
+	read_option("TCPFastOpenQueueLength", result.fast_open_queue_length);
+	read_option("BusyPoll", result.busy_poll);
+	return result;
+}
+
+bool Jupiter::Socket::setOptions(const Options &in_options) {
+	m_data->options = in_options;
+	if (m_data->rawSock == INVALID_SOCKET || m_data->rawSock == 0) {
+		return true;
+	}
+
+	int listening = 0;
+	socklen_t listening_size = sizeof(listening);
+	getsockopt(m_data->rawSock, SOL_SOCKET, SO_ACCEPTCONN, reinterpret_cast<char *>(&listening), &listening_size);
+	return apply_options(m_data->rawSock, in_options, m_data->sockType, listening != 0);
+}
+
+const Jupiter::Socket::Options &Jupiter::Socket::getOptions() const {
+	return m_data->options;
+}
+
+// Accepts a connection on a listening socket, applying the blocking mode (and close-on-exec) on creation where possible
+static Jupiter::Socket::SocketType accept_descriptor(Jupiter::Socket::SocketType in_listener, bool in_blocking, sockaddr_storage& out_address, socklen_t& out_address_size) {
+	out_address_size = sizeof(out_address);
+	sockaddr* address = reinterpret_cast<sockaddr*>(&out_address);
+#if defined __linux__
+	return ::accept4(in_listener, address, &out_address_size, SOCK_CLOEXEC | (in_blocking ? 0 : SOCK_NONBLOCK));
+#elif defined _WIN32
+	Jupiter::Socket::SocketType result = ::accept(in_listener, address, &out_address_size);
+	if (result != INVALID_SOCKET) {
+		// Accepted sockets inherit the listener's blocking mode
+		unsigned long block_mode = !in_blocking;
+		ioctlsocket(result, FIONBIO, &block_mode);
+	}
+	return result;
+#else // __linux__
+	Jupiter::Socket::SocketType result = ::accept(in_listener, address, &out_address_size);
+	if (result != INVALID_SOCKET) {
+		fcntl(result, F_SETFD, FD_CLOEXEC);
+		if (!in_blocking) {
+			fcntl(result, F_SETFL, fcntl(result, F_GETFL, 0) | O_NONBLOCK);
+		}
+	}
+	return result;
+#endif // __linux__
+}
+
 Jupiter::Socket* Jupiter::Socket::accept() {
-	sockaddr addr;
-	socklen_t size = sizeof(addr);
-	SocketType tSock = ::accept(m_data->rawSock, &addr, &size);
+	sockaddr_storage addr;
+	socklen_t size;
+	SocketType tSock = accept_descriptor(m_data->rawSock, true, addr, size);
 	if (tSock != INVALID_SOCKET) {
-		char resolved[NI_MAXHOST];
-		char resolved_port[NI_MAXSERV];
-		getnameinfo(&addr, size, resolved, sizeof(resolved), resolved_port, sizeof(resolved_port), NI_NUMERICHOST | NI_NUMERICSERV);
 		Socket *result = new Socket(m_data->buffer.capacity());
-		result->m_data->rawSock = tSock;
-		result->m_data->sockType = m_data->sockType;
-		result->m_data->sockProto = m_data->sockProto;
-		result->m_data->remote_host = resolved;
-		result->m_data->remote_port = static_cast<unsigned short>(Jupiter_strtoi(resolved_port, 10));
+		result->setAccepted(*this, tSock, true, reinterpret_cast<sockaddr*>(&addr), size);
 		return result;
 	}
 	return nullptr;
 }
 
+bool Jupiter::Socket::accept(Socket &out_socket, bool in_blocking) {
+	sockaddr_storage addr;
+	socklen_t size;
+	SocketType tSock = accept_descriptor(m_data->rawSock, in_blocking, addr, size);
+	if (tSock == INVALID_SOCKET) {
+		return false;
+	}
+
+	if (out_socket.m_data->rawSock > 0) {
+		out_socket.close();
+	}
+
+	out_socket.m_data->buffer.clear();
+	out_socket.setAccepted(*this, tSock, in_blocking, reinterpret_cast<sockaddr*>(&addr), size);
+	return true;
+}
+
+// blocking is only recorded on Windows, where the mode can't be queried; accept_descriptor() has already applied it everywhere
+void Jupiter::Socket::setAccepted(const Socket &listener, SocketType descriptor, [[maybe_unused]] bool blocking, const sockaddr *address, size_t address_size) {
+	m_data->rawSock = descriptor;
+	m_data->sockType = listener.m_data->sockType;
+	m_data->sockProto = listener.m_data->sockProto;
+	m_data->is_shutdown = false;
+#if defined _WIN32
+	m_data->blockMode = !blocking;
+#endif // _WIN32
+
+	// The port is cheap to extract; the hostname is only formatted if getRemoteHostname() is called
+	address_size = std::min(address_size, sizeof(m_data->remote_address));
+	std::memcpy(&m_data->remote_address, address, address_size);
+	m_data->remote_address_size = static_cast<socklen_t>(address_size);
+	m_data->remote_host.clear();
+	switch (address->sa_family) {
+	case AF_INET:
+		m_data->remote_port = ntohs(reinterpret_cast<const sockaddr_in*>(address)->sin_port);
+		break;
+	case AF_INET6:
+		m_data->remote_port = ntohs(reinterpret_cast<const sockaddr_in6*>(address)->sin6_port);
+		break;
+	default:
+		m_data->remote_port = 0;
+		break;
+	}
+}
+
 bool Jupiter::Socket::setReadTimeout(unsigned long milliseconds) {
 #if defined _WIN32
 	return setsockopt(m_data->rawSock, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char *>(&milliseconds), sizeof(milliseconds)) == 0;
@@ -497,11 +1032,19 @@ bool Jupiter::Socket::getBlockingMode() const {
 }
 
 const std::string &Jupiter::Socket::getRemoteHostname() const {
+	if (m_data->remote_address_size != 0) {
+		char resolved[NI_MAXHOST];
+		if (getnameinfo(reinterpret_cast<const sockaddr*>(&m_data->remote_address), m_data->remote_address_size, resolved, sizeof(resolved), nullptr, 0, NI_NUMERICHOST) == 0) {
+			m_data->remote_host = resolved;
+		}
+		m_data->remote_address_size = 0;
+	}
+
 	return m_data->remote_host;
 }
 
 const char *Jupiter::Socket::getRemoteHostnameC() const {
-	return m_data->remote_host.c_str();
+	return getRemoteHostname().c_str();
 }
 
 const std::string &Jupiter::Socket::getBoundHostname() const {
@@ -534,7 +1077,7 @@ std::string_view Jupiter::Socket::setBufferSize(size_t size) {
 }
 
 std::string_view Jupiter::Socket::getData() {
-	if (this->recv() <= 0) {
+	if (this->recv() <= 0 && !m_data->retain_buffer) {
 		m_data->buffer.clear();
 	}
 	return m_data->buffer.view();
@@ -550,6 +1093,18 @@ void Jupiter::Socket::clearBuffer() {
 	m_data->buffer.clear();
 }
 
+void Jupiter::Socket::setRetainBuffer(bool in_retain) {
+	m_data->retain_buffer = in_retain;
+}
+
+bool Jupiter::Socket::getRetainBuffer() const {
+	return m_data->retain_buffer;
+}
+
+void Jupiter::Socket::consumeBuffer(size_t in_count) {
+	m_data->buffer.consume(in_count);
+}
+
 int Jupiter::Socket::send(const char *data, size_t datalen) {
 	return ::send(m_data->rawSock, data, datalen, 0);
 }
@@ -562,6 +1117,66 @@ int Jupiter::Socket::send(const char *msg) {
 	return this->send(msg, strlen(msg));
 }
 
+int Jupiter::Socket::sendv(std::span<const std::string_view> in_buffers) {
+	in_buffers = in_buffers.first(std::min(in_buffers.size(), s_max_send_buffers));
+
+#if defined _WIN32
+	WSABUF buffers[s_max_send_buffers];
+	for (size_t index = 0; index != in_buffers.size(); ++index) {
+		buffers[index].buf = const_cast<char*>(in_buffers[index].data());
+		buffers[index].len = static_cast<ULONG>(in_buffers[index].size());
+	}
+
+	DWORD bytes_sent{};
+	if (WSASend(m_data->rawSock, buffers, static_cast<DWORD>(in_buffers.size()), &bytes_sent, 0, nullptr, nullptr) != 0) {
+		return SOCKET_ERROR;
+	}
+	return static_cast<int>(bytes_sent);
+#else // _WIN32
+	iovec buffers[s_max_send_buffers];
+	for (size_t index = 0; index != in_buffers.size(); ++index) {
+		buffers[index].iov_base = const_cast<char*>(in_buffers[index].data());
+		buffers[index].iov_len = in_buffers[index].size();
+	}
+
+	msghdr message{};
+	message.msg_iov = buffers;
+	message.msg_iovlen = in_buffers.size();
+	return static_cast<int>(::sendmsg(m_data->rawSock, &message, 0));
+#endif // _WIN32
+}
+
+int Jupiter::Socket::sendFile(int in_fd, uint64_t in_offset, size_t in_count) {
+#if defined __linux__
+	off_t offset = static_cast<off_t>(in_offset);
+	in_count = std::min<size_t>(in_count, INT_MAX);
+	return static_cast<int>(::sendfile(m_data->rawSock, in_fd, &offset, in_count));
+#else // __linux__
+	return sendFileBuffered(in_fd, in_offset, in_count);
+#endif // __linux__
+}
+
+int Jupiter::Socket::sendFileBuffered(int in_fd, uint64_t in_offset, size_t in_count) {
+	char buffer[s_send_file_buffer_size];
+	in_count = std::min(in_count, sizeof(buffer));
+
+#if defined _WIN32
+	if (_lseeki64(in_fd, static_cast<__int64>(in_offset), SEEK_SET) < 0) {
+		return SOCKET_ERROR;
+	}
+	int bytes_read = _read(in_fd, buffer, static_cast<unsigned int>(in_count));
+#else // _WIN32
+	int bytes_read = static_cast<int>(::pread(in_fd, buffer, in_count, static_cast<off_t>(in_offset)));
+#endif // _WIN32
+
+	if (bytes_read <= 0) { // Read error, or file truncated
+		return SOCKET_ERROR;
+	}
+
+	// Partial sends are fine; the unsent remainder is read again by the next call
+	return this->send(buffer, bytes_read);
+}
+
 int Jupiter::Socket::sendTo(const addrinfo *info, const char *data, size_t datalen) {
 	return sendto(m_data->rawSock, data, datalen, 0, info->ai_addr, info->ai_addrlen);
 }
@@ -599,10 +1214,10 @@ int Jupiter::Socket::peekFrom(addrinfo *info) {
 }
 
 int Jupiter::Socket::recv() {
-	m_data->buffer.clear();
-	int r = ::recv(m_data->rawSock, m_data->buffer.chr_data(), m_data->buffer.capacity(), 0);
+	std::span<char> space = prepareReceive();
+	int r = ::recv(m_data->rawSock, space.data(), space.size(), 0);
 	if (r > 0) {
-		m_data->buffer.set_length(r);
+		m_data->buffer.commit(r);
 	}
 	return r;
 }
@@ -674,6 +1289,16 @@ Jupiter::Socket::Buffer &Jupiter::Socket::getInternalBuffer() const {
 	return m_data->buffer;
 }
 
+std::span<char> Jupiter::Socket::prepareReceive() {
+	if (!m_data->retain_buffer) {
+		m_data->buffer.clear();
+		return { m_data->buffer.chr_data(), m_data->buffer.capacity() };
+	}
+
+	char* space = m_data->buffer.prepare(s_min_receive_space);
+	return { space, m_data->buffer.free_space() };
+}
+
 /** Re-enable warnings */
 #if defined _MSC_VER
 #pragma warning(pop)
@@ -132,6 +132,17 @@ size_t Jupiter::Timer::check()
 	return result;
 }
 
+std::chrono::steady_clock::time_point Jupiter::Timer::next()
+{
+	auto result = std::chrono::steady_clock::time_point::max();
+
+	for (Jupiter::Timer *timer : o_timers)
+		if (timer->m_next_call < result)
+			result = timer->m_next_call;
+
+	return result;
+}
+
 size_t Jupiter::Timer::killAll()
 {
 	size_t result = o_timers.size();
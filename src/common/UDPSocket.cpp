@@ -16,15 +16,35 @@
  * Written by Jessica James <jessica.aj@outlook.com>
  */
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
 #include "UDPSocket.h"
 
 #if defined _WIN32
 #include <WinSock2.h>
+#include <ws2tcpip.h>
 #else // _WIN32
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
+#include <netinet/udp.h>
+#include <cerrno>
+#define SOCKET_ERROR (-1)
 #endif // _WIN32
 
+// UDP GSO/GRO; defined by linux/udp.h, which may be newer than netinet/udp.h
+#if defined __linux__
+#if !defined UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif // UDP_SEGMENT
+#if !defined UDP_GRO
+#define UDP_GRO 104
+#endif // UDP_GRO
+#endif // __linux__
+
+constexpr size_t s_max_datagram_batch = 64; // Maximum number of datagrams passed to the kernel in one call
+
 void setSocketUDP(Jupiter::Socket *sock)
 {
 	sock->setType(SOCK_DGRAM);
@@ -52,4 +72,166 @@ Jupiter::UDPSocket::UDPSocket(size_t bufferSize) : Socket(bufferSize)
 Jupiter::UDPSocket::UDPSocket(Jupiter::Socket &&source) : Socket(std::move(source))
 {
 	setSocketUDP(this);
-}
\ No newline at end of file
+}
+
+int Jupiter::UDPSocket::recvBatch(std::span<Datagram> io_datagrams) {
+	io_datagrams = io_datagrams.first(std::min(io_datagrams.size(), s_max_datagram_batch));
+	if (io_datagrams.empty()) {
+		return 0;
+	}
+
+#if defined __linux__
+	mmsghdr messages[s_max_datagram_batch];
+	iovec buffers[s_max_datagram_batch];
+	alignas(cmsghdr) char controls[s_max_datagram_batch][CMSG_SPACE(sizeof(int))]; // UDP_GRO segment size
+	for (size_t index = 0; index != io_datagrams.size(); ++index) {
+		Datagram& datagram = io_datagrams[index];
+		buffers[index].iov_base = datagram.data;
+		buffers[index].iov_len = datagram.capacity;
+		messages[index].msg_hdr = {};
+		messages[index].msg_hdr.msg_name = datagram.address;
+		messages[index].msg_hdr.msg_namelen = datagram.address != nullptr ? static_cast<socklen_t>(datagram.address_size) : 0;
+		messages[index].msg_hdr.msg_iov = &buffers[index];
+		messages[index].msg_hdr.msg_iovlen = 1;
+		messages[index].msg_hdr.msg_control = controls[index];
+		messages[index].msg_hdr.msg_controllen = sizeof(controls[index]);
+		messages[index].msg_len = 0;
+	}
+
+	// Wait for the first datagram (if blocking), then take whatever else is already queued
+	int result = ::recvmmsg(this->getDescriptor(), messages, static_cast<unsigned int>(io_datagrams.size()), MSG_WAITFORONE, nullptr);
+	if (result <= 0) {
+		return result;
+	}
+
+	for (int index = 0; index != result; ++index) {
+		Datagram& datagram = io_datagrams[index];
+		msghdr& header = messages[index].msg_hdr;
+		datagram.size = messages[index].msg_len;
+		datagram.address_size = header.msg_namelen;
+		datagram.truncated = (header.msg_flags & MSG_TRUNC) != 0;
+		datagram.segment_size = 0;
+		for (cmsghdr* control = CMSG_FIRSTHDR(&header); control != nullptr; control = CMSG_NXTHDR(&header, control)) {
+			if (control->cmsg_level == IPPROTO_UDP && control->cmsg_type == UDP_GRO) {
+				int segment_size;
+				std::memcpy(&segment_size, CMSG_DATA(control), sizeof(segment_size));
+				datagram.segment_size = static_cast<size_t>(segment_size);
+			}
+		}
+	}
+
+	return result;
+#else // __linux__
+	int count = 0;
+	for (Datagram& datagram : io_datagrams) {
+#if defined _WIN32
+		// There's no per-call non-blocking flag; only a non-blocking socket can be drained without waiting
+		if (count != 0 && this->getBlockingMode()) {
+			break;
+		}
+		int address_size = datagram.address != nullptr ? static_cast<int>(datagram.address_size) : 0;
+		int result = ::recvfrom(this->getDescriptor(), datagram.data, static_cast<int>(datagram.capacity), 0, datagram.address, datagram.address != nullptr ? &address_size : nullptr);
+		datagram.truncated = result == SOCKET_ERROR && WSAGetLastError() == WSAEMSGSIZE;
+		if (datagram.truncated) {
+			result = static_cast<int>(datagram.capacity);
+		}
+#else // _WIN32
+		// Only wait on the first datagram
+		int flags = count == 0 ? 0 : MSG_DONTWAIT;
+		socklen_t address_size = datagram.address != nullptr ? static_cast<socklen_t>(datagram.address_size) : 0;
+		msghdr header{};
+		iovec buffer{ datagram.data, datagram.capacity };
+		header.msg_name = datagram.address;
+		header.msg_namelen = address_size;
+		header.msg_iov = &buffer;
+		header.msg_iovlen = 1;
+		int result = static_cast<int>(::recvmsg(this->getDescriptor(), &header, flags));
+		address_size = header.msg_namelen;
+		datagram.truncated = (header.msg_flags & MSG_TRUNC) != 0;
+#endif // _WIN32
+		if (result < 0) {
+			// Running out of datagrams after the first isn't an error
+			return count == 0 ? SOCKET_ERROR : count;
+		}
+
+		datagram.size = static_cast<size_t>(result);
+		datagram.address_size = static_cast<size_t>(address_size);
+		datagram.segment_size = 0;
+		++count;
+	}
+
+	return count;
+#endif // __linux__
+}
+
+int Jupiter::UDPSocket::sendBatch(std::span<const Datagram> in_datagrams) {
+	in_datagrams = in_datagrams.first(std::min(in_datagrams.size(), s_max_datagram_batch));
+	if (in_datagrams.empty()) {
+		return 0;
+	}
+
+#if defined __linux__
+	mmsghdr messages[s_max_datagram_batch];
+	iovec buffers[s_max_datagram_batch];
+	alignas(cmsghdr) char controls[s_max_datagram_batch][CMSG_SPACE(sizeof(uint16_t))]; // UDP_SEGMENT size
+	for (size_t index = 0; index != in_datagrams.size(); ++index) {
+		const Datagram& datagram = in_datagrams[index];
+		buffers[index].iov_base = datagram.data;
+		buffers[index].iov_len = datagram.size;
+		messages[index].msg_hdr = {};
+		messages[index].msg_hdr.msg_name = datagram.address;
+		messages[index].msg_hdr.msg_namelen = datagram.address != nullptr ? static_cast<socklen_t>(datagram.address_size) : 0;
+		messages[index].msg_hdr.msg_iov = &buffers[index];
+		messages[index].msg_hdr.msg_iovlen = 1;
+		messages[index].msg_len = 0;
+
+		// Have the kernel split the payload into datagrams (UDP GSO)
+		if (datagram.segment_size != 0 && datagram.segment_size < datagram.size) {
+			msghdr& header = messages[index].msg_hdr;
+			header.msg_control = controls[index];
+			header.msg_controllen = sizeof(controls[index]);
+			cmsghdr* control = CMSG_FIRSTHDR(&header);
+			control->cmsg_level = IPPROTO_UDP;
+			control->cmsg_type = UDP_SEGMENT;
+			control->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+			uint16_t segment_size = static_cast<uint16_t>(datagram.segment_size);
+			std::memcpy(CMSG_DATA(control), &segment_size, sizeof(segment_size));
+		}
+	}
+
+	return ::sendmmsg(this->getDescriptor(), messages, static_cast<unsigned int>(in_datagrams.size()), 0);
+#else // __linux__
+	int count = 0;
+	for (const Datagram& datagram : in_datagrams) {
+		// Split the payload into datagrams ourselves
+		size_t segment_size = datagram.segment_size != 0 ? datagram.segment_size : datagram.size;
+		size_t offset = 0;
+		do {
+			size_t length = std::min(segment_size, datagram.size - offset);
+#if defined _WIN32
+			int result = ::sendto(this->getDescriptor(), datagram.data + offset, static_cast<int>(length), 0, datagram.address, static_cast<int>(datagram.address_size));
+#else // _WIN32
+			int result = static_cast<int>(::sendto(this->getDescriptor(), datagram.data + offset, length, 0, datagram.address, static_cast<socklen_t>(datagram.address_size)));
+#endif // _WIN32
+			if (result < 0) {
+				// Report the datagrams sent so far, if any; a partially sent entry isn't counted
+				return count == 0 ? SOCKET_ERROR : count;
+			}
+			offset += length;
+		} while (offset < datagram.size);
+
+		++count;
+	}
+
+	return count;
+#endif // __linux__
+}
+
+bool Jupiter::UDPSocket::setReceiveOffload(bool in_enabled) {
+#if defined __linux__
+	int value = in_enabled ? 1 : 0;
+	return setsockopt(this->getDescriptor(), IPPROTO_UDP, UDP_GRO, &value, sizeof(value)) == 0;
+#else // __linux__
+	return !in_enabled;
+#endif // __linux__
+}
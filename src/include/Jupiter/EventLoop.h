@@ -0,0 +1,205 @@
+/**
+ * Copyright (C) 2021 Jessica James.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Written by Jessica James <jessica.aj@outlook.com>
+ */
+
+#if !defined _EVENTLOOP_H_HEADER
+#define _EVENTLOOP_H_HEADER
+
+/**
+ * @file EventLoop.h
+ * @brief Provides an event loop which sleeps until sockets, timers, or Thinkers have work to do.
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include "Jupiter.h"
+
+namespace Jupiter
+{
+	class Socket;
+	class Thinker;
+
+	/**
+	* @brief Waits for readiness on descriptors, timers, and tasks posted from other threads, and dispatches them.
+	* On Linux, this is built on epoll, with a timerfd for deadlines and an eventfd for wake-ups; elsewhere, it polls
+	* with poll() at short intervals.
+	* Thinkers may be driven by a loop as well: each is thought whenever the descriptor from Thinker::getDescriptor()
+	* becomes readable, and otherwise on an interval, so code written against think() keeps working unchanged.
+	* Note: Only post(), wake(), and stop() may be called from threads other than the one running the loop.
+	*/
+	class JUPITER_API EventLoop
+	{
+	public:
+		/** Readiness events; combined as flags */
+		enum Event : uint32_t {
+			READ = 1,
+			WRITE = 2,
+			CLOSED = 4 // Error or hang-up; always reported, whether or not it's requested
+		};
+
+		typedef std::function<void(uint32_t in_events)> Callback;
+		typedef std::function<void()> Task;
+		typedef std::function<void(int in_result)> ThinkerCallback;
+		typedef uint64_t TimerID;
+
+		/**
+		* @brief Starts watching a descriptor for readiness, or replaces the events and callback of one already watched.
+		* Watches are level-triggered: the callback is called on every iteration while the descriptor remains ready.
+		* Note: Descriptors must be unwatched before they are closed.
+		*
+		* @param in_descriptor Descriptor to watch.
+		* @param in_events Events to watch for (see Event).
+		* @param in_callback Function to call with the events which occurred.
+		* @return True on success, false otherwise.
+		*/
+		bool watch(int in_descriptor, uint32_t in_events, Callback in_callback);
+
+		/**
+		* @brief Starts watching a socket for readiness; see watch(int, uint32_t, Callback).
+		* Note: SecureSockets may hold decrypted data which no longer makes the socket readable; see SecureSocket::getPending().
+		*/
+		bool watch(Socket &in_socket, uint32_t in_events, Callback in_callback);
+
+		/**
+		* @brief Stops watching a descriptor.
+		*
+		* @param in_descriptor Descriptor to stop watching.
+		* @return True if the descriptor was watched, false otherwise.
+		*/
+		bool unwatch(int in_descriptor);
+
+		/**
+		* @brief Stops watching a socket.
+		*
+		* @param in_socket Socket to stop watching.
+		* @return True if the socket was watched, false otherwise.
+		*/
+		bool unwatch(Socket &in_socket);
+
+		/**
+		* @brief Schedules a task to run after a delay.
+		*
+		* @param in_delay Time to wait before running the task.
+		* @param in_task Task to run.
+		* @param in_repeat True if the task should run every in_delay until cancelled, false to run it once.
+		* @return Identifier to pass to cancelTimer().
+		*/
+		TimerID addTimer(std::chrono::milliseconds in_delay, Task in_task, bool in_repeat = false);
+
+		/**
+		* @brief Cancels a timer from addTimer().
+		*
+		* @param in_timer Timer to cancel.
+		* @return True if the timer was pending, false otherwise.
+		*/
+		bool cancelTimer(TimerID in_timer);
+
+		/**
+		* @brief Drives a Thinker from this loop. It is thought whenever its descriptor becomes readable, and at least once per interval.
+		* A Thinker which returns non-zero from think() is removed, and then passed to in_on_finished (i.e: to delete it).
+		*
+		* @param in_thinker Thinker to drive; this must outlive its registration.
+		* @param in_interval Longest time between calls to think().
+		* @param in_on_finished Optional function to call with the non-zero result of think() after it is removed.
+		*/
+		void addThinker(Thinker &in_thinker, std::chrono::milliseconds in_interval, ThinkerCallback in_on_finished = nullptr);
+
+		/**
+		* @brief Stops driving a Thinker.
+		*
+		* @param in_thinker Thinker to remove.
+		* @return True if the Thinker was driven by this loop, false otherwise.
+		*/
+		bool removeThinker(Thinker &in_thinker);
+
+		/**
+		* @brief Sets whether this loop calls Timer::check() as Jupiter::Timers come due.
+		* Note: Timers aren't thread-safe; only one loop, on the thread which creates them, should run them.
+		*
+		* @param in_run_timers True to run Timers from this loop, false otherwise.
+		*/
+		void setRunTimers(bool in_run_timers);
+
+		/**
+		* @brief Checks whether this loop runs Jupiter::Timers.
+		*
+		* @return True if this loop calls Timer::check(), false otherwise.
+		*/
+		bool getRunTimers() const;
+
+		/**
+		* @brief Queues a task to run on the loop's thread, waking it. This may be called from any thread.
+		*
+		* @param in_task Task to run.
+		*/
+		void post(Task in_task);
+
+		/**
+		* @brief Interrupts the loop if it is waiting. This may be called from any thread.
+		*/
+		void wake();
+
+		/**
+		* @brief Makes run() return once the current iteration completes. This may be called from any thread.
+		*/
+		void stop();
+
+		/**
+		* @brief Waits until there is work to do, and does it.
+		*
+		* @param in_timeout Longest time to wait; negative to wait indefinitely.
+		* @return Number of callbacks, tasks, and Thinkers run.
+		*/
+		size_t runOnce(std::chrono::milliseconds in_timeout = std::chrono::milliseconds{ -1 });
+
+		/**
+		* @brief Runs the loop until stop() is called.
+		*/
+		void run();
+
+		/**
+		* @brief Fetches the epoll descriptor, which becomes readable when the loop has work to do.
+		* This allows a loop to be nested in another loop, or driven by some other readiness API.
+		*
+		* @return Descriptor of the epoll instance, or -1 if epoll isn't in use.
+		*/
+		int getDescriptor() const;
+
+		/**
+		* @brief Default constructor for the EventLoop class.
+		*/
+		EventLoop();
+
+		/**
+		* @brief Copying an EventLoop is forbidden.
+		*/
+		EventLoop(const EventLoop &) = delete;
+
+		/**
+		* @brief Destructor for the EventLoop class.
+		*/
+		~EventLoop();
+
+	/** Private members */
+	private:
+		struct Data;
+		Data *m_data;
+	};
+}
+
+#endif // _EVENTLOOP_H_HEADER
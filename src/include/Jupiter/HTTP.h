@@ -156,6 +156,9 @@ namespace Text {
 
 static constexpr std::string_view HTML = "text/html";
 static constexpr std::string_view PLAIN = "text/plain";
+static constexpr std::string_view CSS = "text/css";
+static constexpr std::string_view JAVASCRIPT = "text/javascript";
+static constexpr std::string_view CSV = "text/csv";
 
 namespace Charset {
 
@@ -168,8 +171,27 @@ static constexpr std::string_view UTF8 = "utf-8";
 
 namespace Application {
 static constexpr std::string_view OCTET_STREAM = "application/octet-stream";
+static constexpr std::string_view JSON = "application/json";
+static constexpr std::string_view XML = "application/xml";
+static constexpr std::string_view PDF = "application/pdf";
+static constexpr std::string_view ZIP = "application/zip";
+static constexpr std::string_view WASM = "application/wasm";
 } // namespace Application
 
+namespace Image {
+static constexpr std::string_view PNG = "image/png";
+static constexpr std::string_view JPEG = "image/jpeg";
+static constexpr std::string_view GIF = "image/gif";
+static constexpr std::string_view SVG = "image/svg+xml";
+static constexpr std::string_view ICON = "image/x-icon";
+static constexpr std::string_view WEBP = "image/webp";
+} // namespace Image
+
+namespace Font {
+static constexpr std::string_view WOFF = "font/woff";
+static constexpr std::string_view WOFF2 = "font/woff2";
+} // namespace Font
+
 } // namespace Type
 } // namespace Content
 } // namespace HTTP
@@ -24,8 +24,15 @@
  * @brief Provides an interface to distribute data using HTTP.
  */
 
+#include <chrono>
+#include <filesystem>
+#include <functional>
 #include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
 #include "Jupiter.h"
+#include "Socket.h"
 #include "Thinker.h"
 
 /** DLL Linkage Nagging */
@@ -36,30 +43,134 @@
 
 namespace Jupiter
 {
+	class Config;
+
 	namespace HTTP
 	{
 		class JUPITER_API Server : public Thinker
 		{
 		public: // Jupiter::Thinker
 			virtual int think();
+			virtual int getDescriptor() const; // epoll descriptor of the sessions serviced by think(), or -1
 
 		public: // Server
 			typedef std::string* HTTPFunction(std::string_view query_string);
+
+			/**
+			* @brief Produces a streamed response body, one part at a time.
+			* This is called each time the session can accept more output, until it returns false; it is not called
+			* again while the socket is still sending previous parts, so slow clients pause the producer.
+			* When nothing is ready yet, return true and leave out_chunk empty; the stream is then paused until its
+			* HTTPStreamResume is called, or otherwise retried every getStreamRetryInterval(). Streams which send nothing
+			* for longer than getStreamTimeout() are closed.
+			*
+			* @param out_chunk Empty buffer to append the next part of the body to
+			* @return True if there is more of the body to produce, false once the body is complete
+			*/
+			typedef std::function<bool(std::string& out_chunk)> HTTPStreamProducer;
+			typedef HTTPStreamProducer HTTPStreamFunction(std::string_view query_string);
+
+			/**
+			* @brief Resumes a stream which its producer paused, so that the producer is called again promptly.
+			* This may be called from any thread, and at any time; calls after the stream ends are ignored.
+			*/
+			typedef std::function<void()> HTTPStreamResume;
 			static constexpr std::string_view server_string{ "Jupiter" };
 
 			struct JUPITER_API Content
 			{
 				bool free_result = true;
-				Jupiter::HTTP::Server::HTTPFunction *function; // function to generate content data
+				bool async = false; // Whether execute() is called on the server's handler threads, rather than blocking its event loop
+				Jupiter::HTTP::Server::HTTPFunction *function = nullptr; // function to generate content data
+				Jupiter::HTTP::Server::HTTPStreamFunction *stream_function = nullptr; // function to start streaming content data; used instead of function when set
 				std::string name; // name of the content
-				unsigned int name_checksum; // name.calcChecksum()
 				std::string_view language; // Pointer to a constant (or otherwise managed) string
 				std::string_view type; // Pointer to a constant (or otherwise managed) string
 				std::string_view charset; // Pointer to a constant (or otherwise managed) string
+				std::string headers; // Content-Type & Content-Language header lines, generated by update_headers()
+				struct Cache;
+				std::unique_ptr<Cache> cache; // Generated responses, keyed by query string; see enable_cache()
 
 				virtual std::string* execute(std::string_view query_string);
 
+				/**
+				* @brief Starts streaming a response body. Streamed responses are sent using chunked transfer encoding on
+				* HTTP/1.1; HTTP/1.0 clients have the connection closed at the end of the body instead.
+				*
+				* @param query_string Query string from the request
+				* @return Producer for the response body
+				*/
+				virtual HTTPStreamProducer stream(std::string_view query_string);
+
+				/**
+				* @brief Starts streaming a response body, for producers which pause their stream while waiting on data.
+				* By default, this ignores in_resume and calls stream(query_string).
+				*
+				* @param query_string Query string from the request
+				* @param in_resume Function which resumes the stream once it's paused; see HTTPStreamProducer
+				* @return Producer for the response body
+				*/
+				virtual HTTPStreamProducer stream(std::string_view query_string, HTTPStreamResume in_resume);
+
+				/**
+				* @brief Checks whether responses are streamed through stream(), rather than generated by execute().
+				* By default, this is true when stream_function is set; override it alongside stream() to stream without one.
+				*
+				* @return True if the content is streamed, false otherwise
+				*/
+				virtual bool is_streamed() const;
+
+				/**
+				* @brief Regenerates the precomputed headers from type, charset, and language.
+				* Note: This is called when the content is hooked; call it again if those are changed afterwards.
+				*/
+				void update_headers();
+
+				/**
+				* @brief Enables caching of generated responses, keyed by query string.
+				* Cached responses are served without calling execute(), and carry an ETag so that clients can revalidate them.
+				* Note: This has no effect on streamed content. Call this before the content is hooked.
+				*
+				* @param in_ttl How long a response is served from the cache after it's generated
+				* @param in_max_size Upper bound on the size of cached responses; least recently used responses are evicted first
+				*/
+				void enable_cache(std::chrono::milliseconds in_ttl, size_t in_max_size = 1024 * 1024);
+
+				/**
+				* @brief Disables caching, and frees any cached responses.
+				*/
+				void disable_cache();
+
 				Content(std::string in_name, Jupiter::HTTP::Server::HTTPFunction in_function);
+				Content(std::string in_name, Jupiter::HTTP::Server::HTTPStreamFunction in_function);
+				virtual ~Content();
+			};
+
+			/**
+			* @brief Content which serves a file from disk, or every file beneath a directory when mounted.
+			* Files are sent using sendfile() on plain sockets, and read in chunks on TLS sockets. Range requests,
+			* Last-Modified and If-Modified-Since are supported. Open files are cached, and reused until file_cache_ttl passes.
+			* Note: When type is empty, the Content-Type is chosen by file extension.
+			*/
+			struct JUPITER_API FileContent : public Content
+			{
+				std::filesystem::path path; // File to serve; or when mounted, directory to serve files from
+				bool mount; // Whether requests beneath this content's name are served from files beneath path; i.e: "name/css/site.css"
+				std::chrono::milliseconds file_cache_ttl = std::chrono::milliseconds(5000); // How long an open file is reused before it's reopened
+				size_t file_cache_size = 64; // Maximum number of open files to cache
+				struct Files;
+				std::unique_ptr<Files> files; // Open file cache
+
+				/**
+				* @brief Reads the entire file into a string. Mounted directories return nullptr.
+				*
+				* @param query_string Ignored
+				* @return Contents of the file, or nullptr on failure
+				*/
+				std::string* execute(std::string_view query_string) override;
+
+				FileContent(std::string in_name, std::filesystem::path in_path, bool in_mount = false);
+				~FileContent();
 			};
 
 			class JUPITER_API Directory
@@ -68,7 +179,6 @@ namespace Jupiter
 				std::vector<std::unique_ptr<Server::Directory>> directories;
 				std::vector<std::unique_ptr<Server::Content>> content;
 				std::string name;
-				unsigned int name_checksum;
 
 				virtual void hook(std::string_view path, std::unique_ptr<Content> in_content);
 				virtual bool remove(std::string_view path, std::string_view name);
@@ -99,8 +209,203 @@ namespace Jupiter
 			std::string* execute(std::string_view host, std::string_view name, std::string_view query_string);
 
 			bool bind(std::string_view hostname, uint16_t port = 80);
+
+			/**
+			* @brief Listens for HTTPS connections. TLS handshakes are driven by the event loop, alongside other sessions.
+			*
+			* @param hostname Hostname to bind to
+			* @param port Port to bind to
+			* @param certificate Path to the PEM certificate chain to present to clients
+			* @param key Path to the PEM private key; if empty, the key is read from the certificate file
+			* @return True on success, false otherwise
+			*/
+			bool tls_bind(std::string_view hostname, uint16_t port, std::string_view certificate, std::string_view key = {});
+
+			/**
+			* @brief Listens for HTTPS connections, presenting the certificate set by setCertificate().
+			*
+			* @param hostname Hostname to bind to
+			* @param port Port to bind to
+			* @return True on success, false if no certificate is set or the port can't be bound
+			*/
 			bool tls_bind(std::string_view hostname, uint16_t port = 443);
 
+			/**
+			* @brief Starts a pool of worker threads, each with its own listeners (SO_REUSEPORT), sessions and event loop.
+			* Listeners from bind() and tls_bind() are moved to the workers; sessions already accepted are still serviced by think().
+			* Note: Content functions will be called concurrently from worker threads. hook() and remove() block request processing.
+			*
+			* @param in_worker_count Number of worker threads to start
+			* @return True on success, false otherwise (i.e: already started, or unsupported on this platform)
+			*/
+			bool start(size_t in_worker_count);
+
+			/**
+			* @brief Stops all worker threads, closing their sessions, and moves listeners back to think().
+			*/
+			void stop();
+
+			/**
+			* @brief Fetches the number of worker threads currently running.
+			*
+			* @return Number of worker threads
+			*/
+			size_t getWorkerCount() const;
+
+			/**
+			* @brief Sets how long a session may take to send its request before it's closed.
+			* Sessions which are already open may keep their previous deadline until they're next checked.
+			*
+			* @param in_timeout Timeout for sessions which aren't kept alive
+			*/
+			void setSessionTimeout(std::chrono::milliseconds in_timeout);
+
+			/**
+			* @brief Fetches how long a session may take to send its request before it's closed.
+			*
+			* @return Timeout for sessions which aren't kept alive
+			*/
+			std::chrono::milliseconds getSessionTimeout() const;
+
+			/**
+			* @brief Sets how long a kept-alive session may stay idle before it's closed.
+			* Sessions which are already open may keep their previous deadline until they're next checked.
+			*
+			* @param in_timeout Timeout for kept-alive sessions
+			*/
+			void setKeepAliveSessionTimeout(std::chrono::milliseconds in_timeout);
+
+			/**
+			* @brief Fetches how long a kept-alive session may stay idle before it's closed.
+			*
+			* @return Timeout for kept-alive sessions
+			*/
+			std::chrono::milliseconds getKeepAliveSessionTimeout() const;
+
+			/**
+			* @brief Sets how long a paused stream may go without sending any output before its session is closed.
+			* Resuming a stream whose producer still has nothing ready doesn't restart this timeout. Sessions waiting for
+			* buffered output to drain (see setMaxBufferedOutput()) are held to the same timeout.
+			*
+			* @param in_timeout Timeout for paused streams
+			*/
+			void setStreamTimeout(std::chrono::milliseconds in_timeout);
+
+			/**
+			* @brief Fetches how long a paused stream may go without sending any output before its session is closed.
+			*
+			* @return Timeout for paused streams
+			*/
+			std::chrono::milliseconds getStreamTimeout() const;
+
+			/**
+			* @brief Sets how often a paused stream's producer is called again without its stream being resumed. Sessions
+			* waiting for buffered output to drain are rechecked as often. Retries are timed to 100 millisecond resolution.
+			*
+			* @param in_interval Interval between retries
+			*/
+			void setStreamRetryInterval(std::chrono::milliseconds in_interval);
+
+			/**
+			* @brief Fetches how often a paused stream's producer is called again without its stream being resumed.
+			*
+			* @return Interval between retries
+			*/
+			std::chrono::milliseconds getStreamRetryInterval() const;
+
+			/**
+			* @brief Sets the limit on unsent output buffered across all sessions. While the server is over this limit,
+			* responses already in flight are still sent, but sessions wait before processing further requests or
+			* producing more of a stream.
+			*
+			* @param in_max_size Limit on buffered output, in bytes
+			*/
+			void setMaxBufferedOutput(size_t in_max_size);
+
+			/**
+			* @brief Fetches the limit on unsent output buffered across all sessions.
+			*
+			* @return Limit on buffered output, in bytes
+			*/
+			size_t getMaxBufferedOutput() const;
+
+			/**
+			* @brief Sets the number of threads which process requests for async content.
+			* Note: The threads are started with the first async request; this has no effect afterwards.
+			*
+			* @param in_thread_count Number of handler threads; at least one is always started
+			*/
+			void setHandlerThreadCount(size_t in_thread_count);
+
+			/**
+			* @brief Fetches the number of threads which process requests for async content.
+			*
+			* @return Number of handler threads
+			*/
+			size_t getHandlerThreadCount() const;
+
+			/**
+			* @brief Sets how many closed sessions each worker keeps for reuse by new connections, along with their buffers.
+			* Pools which are already larger shrink as their unused sessions are trimmed.
+			*
+			* @param in_max_sessions Upper bound on pooled sessions, per worker
+			*/
+			void setMaxFreeSessions(size_t in_max_sessions);
+
+			/**
+			* @brief Fetches how many closed sessions each worker keeps for reuse by new connections.
+			*
+			* @return Upper bound on pooled sessions, per worker
+			*/
+			size_t getMaxFreeSessions() const;
+
+			/**
+			* @brief Sets the certificate presented by listeners which tls_bind() binds afterwards without one of their own.
+			*
+			* @param certificate Path to the PEM certificate chain to present to clients
+			* @param key Path to the PEM private key; if empty, the key is read from the certificate file
+			*/
+			void setCertificate(std::string_view certificate, std::string_view key = {});
+
+			/**
+			* @brief Requests kernel TLS (kTLS) offload for connections accepted by tls_bind() listeners bound afterwards.
+			* Files are then sent with sendfile(), rather than being read and encrypted in user space. Connections which
+			* the kernel can't take over are served as usual.
+			*
+			* @param in_enabled True to request kTLS, false otherwise
+			*/
+			void setKernelTLS(bool in_enabled);
+
+			/**
+			* @brief Fetches whether kernel TLS offload is requested for new tls_bind() listeners.
+			*
+			* @return True if kTLS is requested, false otherwise
+			*/
+			bool getKernelTLS() const;
+
+			/**
+			* @brief Sets tuning options (i.e: TCP_NODELAY, TCP_FASTOPEN) for listeners bound afterwards.
+			* Sessions accepted from a listener inherit its options from the system.
+			*
+			* @param in_options Socket options to apply
+			*/
+			void setSocketOptions(const Jupiter::Socket::Options& in_options);
+
+			/**
+			* @brief Reads tuning options for listeners bound afterwards from a config section, using the same keys as
+			* IRC::Client; see Socket::Options::read().
+			*
+			* @param in_config Config section to read socket options from
+			*/
+			void setSocketOptions(const Jupiter::Config& in_config);
+
+			/**
+			* @brief Fetches the tuning options applied to new listeners.
+			*
+			* @return Socket options
+			*/
+			const Jupiter::Socket::Options& getSocketOptions() const;
+
 			Server();
 			Server(Jupiter::HTTP::Server &&source);
 			~Server();
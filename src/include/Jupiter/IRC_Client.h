@@ -26,6 +26,7 @@
 
 #include <cstdlib>
 #include <cstdio>
+#include <initializer_list>
 #include <utility>
 #include "jessilib/unicode.hpp"
 #include "Jupiter.h"
@@ -33,6 +34,7 @@
 #include "IRC.h"
 #include "Config.h"
 #include "Socket.h"
+#include "SecureSocket.h"
 
 /** DLL Linkage Nagging */
 #if defined _MSC_VER
@@ -64,7 +66,7 @@ namespace Jupiter
 			virtual void OnDisconnect();
 
 			/**
-			* @brief This is called when at the end of reconnect().
+			* @brief This is called once a connection started by reconnect() is established or fails.
 			*
 			* @param in_success Used to determine if a connection was successfully established.
 			* @see connect().
@@ -556,6 +558,21 @@ namespace Jupiter
 			*/
 			int getMaxReconnectAttempts() const;
 
+			/**
+			* @brief Returns the number of TLS handshakes completed with servers, including resumed sessions.
+			*
+			* @return Number of TLS handshakes completed.
+			*/
+			unsigned int getTLSHandshakeCount() const;
+
+			/**
+			* @brief Returns the number of TLS handshakes which resumed a session from a previous connection.
+			* Together with getTLSHandshakeCount(), this gives the session resumption hit rate.
+			*
+			* @return Number of TLS sessions resumed.
+			*/
+			unsigned int getTLSResumptionCount() const;
+
 			/**
 			* @brief Returns the default channel type.
 			*
@@ -780,9 +797,13 @@ namespace Jupiter
 			/**
 			* @brief Connects the client to its server.
 			* Note: This should not be called unless it is not already connected to a server.
-			* Also, a successful socket connection does not mean the server accepted the connection.
+			* The connection is established by think(), so that an unreachable server never blocks other clients; see
+			* the "ConnectTimeout" config key (in seconds). When the server has several addresses, the next is tried after
+			* "ConnectionAttemptDelay" (in milliseconds). Also, a successful socket connection does not mean the server
+			* accepted the connection.
+			* Socket tuning is read from config as well; see Socket::Options::read().
 			*
-			* @return True upon successful socket connection, false otherwise.
+			* @return True if the connection was started, false otherwise.
 			*/
 			bool connect();
 
@@ -813,6 +834,13 @@ namespace Jupiter
 			*/
 			virtual int think() override;
 
+			/**
+			* @brief Fetches the socket's descriptor while connected, so that an EventLoop can call think() as data arrives.
+			*
+			* @return Descriptor of the connected socket, or -1 while connecting or disconnected.
+			*/
+			virtual int getDescriptor() const override;
+
 			/**
 			* @brief Constructor for a client.
 			*
@@ -835,16 +863,23 @@ namespace Jupiter
 			bool m_ssl;
 			std::string m_ssl_certificate;
 			std::string m_ssl_key;
+			std::unordered_map<std::string, Jupiter::SecureSocket::Session, jessilib::text_hashi, jessilib::text_equali> m_tls_sessions; // Last session per "hostname:port"
+			std::string m_tls_session_server; // Key of the server currently connected to
+			unsigned int m_tls_handshakes = 0;
+			unsigned int m_tls_resumptions = 0;
 
 			std::string m_sasl_account;
 			std::string m_sasl_password;
 
 			int m_connection_status;
+			bool m_reconnecting = false; // Whether OnReconnectAttempt() is due once the pending connection completes
+			std::chrono::milliseconds m_connect_timeout;
+			std::chrono::milliseconds m_connection_attempt_delay; // See Socket::setConnectionAttemptDelay()
+			Jupiter::Socket::Options m_socket_options; // Applied to the socket on each connection attempt
 			std::string m_primary_section_name;
 			Jupiter::Config *m_primary_section;
 			Jupiter::Config *m_secondary_section;
 			std::string m_log_file_name;
-			std::string m_last_line;
 			std::string m_server_name;
 			std::string m_nickname;
 			std::string m_realname;
@@ -875,6 +910,20 @@ namespace Jupiter
 			void addNamesToChannel(Channel &in_channel, std::string_view in_names);
 			void addChannel(std::string_view in_channel);
 
+			/**
+			* @brief Sends a line to the server, followed by CRLF, without concatenating its pieces first.
+			* Lines of more than 8 pieces are concatenated, and sent as one buffer.
+			*
+			* @param in_pieces Pieces of the line, in order
+			* @return Number of bytes sent on success, less than or equal to 0 otherwise.
+			*/
+			int sendLine(std::initializer_list<std::string_view> in_pieces);
+
+			void finishConnect(bool in_success);
+			void offerTLSSession(Jupiter::SecureSocket &in_socket);
+			void countTLSHandshake(const Jupiter::SecureSocket &in_socket);
+			void saveTLSSession();
+
 			bool startCAP();
 			bool registerClient();
 			std::shared_ptr<User> findUser(std::string_view in_nickname) const;
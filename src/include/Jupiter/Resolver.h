@@ -0,0 +1,192 @@
+/**
+ * Copyright (C) 2021 Jessica James.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Written by Jessica James <jessica.aj@outlook.com>
+ */
+
+#if !defined _RESOLVER_H_HEADER
+#define _RESOLVER_H_HEADER
+
+/**
+ * @file Resolver.h
+ * @brief Provides cached hostname resolution, performed on background threads.
+ */
+
+#include <chrono>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Jupiter.h"
+
+struct addrinfo;
+
+namespace Jupiter
+{
+	/**
+	* @brief Resolves hostnames on a small pool of background threads, and caches the results.
+	* Successful lookups are cached for the positive TTL, and failed lookups for the negative TTL, so that repeated
+	* connections to the same hosts (i.e: reconnect attempts) don't each wait on the system resolver.
+	* Numeric addresses are never looked up or cached.
+	*/
+	class JUPITER_API Resolver
+	{
+	public:
+		/** Numeric addresses a hostname resolved to, in order of preference; empty if resolution failed */
+		typedef std::vector<std::string> Addresses;
+
+		/** Function which resolves a hostname; called from the resolver's threads. Exceptions fail the lookup, as if nothing were found */
+		typedef std::function<Addresses(const std::string &hostname)> Lookup;
+
+		/**
+		* @brief Fetches the resolver used by Socket.
+		*
+		* @return Process-wide resolver.
+		*/
+		static Resolver &instance();
+
+		/**
+		* @brief Resolves a hostname without blocking.
+		* Concurrent requests for the same hostname share a single lookup.
+		*
+		* @param hostname Hostname to resolve.
+		* @return Future result of the lookup; this is already ready for cached hostnames and numeric addresses.
+		*/
+		std::shared_future<Addresses> resolve(std::string_view hostname);
+
+		/**
+		* @brief Resolves a hostname, blocking until the result is available, and stores it in addrinfo structs.
+		* The addrinfo returned by this function must be freed by freeAddrInfo().
+		*
+		* @param hostname Hostname to resolve; the system resolver is used directly if this is nullptr or empty.
+		* @param port String containing the target port, or nullptr.
+		* @param hints Optional hints, as for getaddrinfo().
+		* @return Pointer to a NULL-terminated linked list of addrinfo on success, nullptr otherwise.
+		*/
+		addrinfo *getAddrInfo(const char *hostname, const char *port, const addrinfo *hints = nullptr);
+
+		/**
+		* @brief Stores resolved addresses in addrinfo structs, without performing any lookups.
+		* The addrinfo returned by this function must be freed by freeAddrInfo().
+		*
+		* @param addresses Numeric addresses to store, such as from resolve().
+		* @param port String containing the target port, or nullptr.
+		* @param hints Optional hints, as for getaddrinfo(); addresses not matching the family are skipped.
+		* @return Pointer to a NULL-terminated linked list of addrinfo on success, nullptr otherwise.
+		*/
+		static addrinfo *makeAddrInfo(const Addresses &addresses, const char *port, const addrinfo *hints = nullptr);
+
+		/**
+		* @brief Frees addrinfo returned by getAddrInfo() or makeAddrInfo().
+		*
+		* @param info Pointer to the addrinfo to be freed.
+		*/
+		static void freeAddrInfo(addrinfo *info);
+
+		/**
+		* @brief Resolves a hostname through the system resolver (getaddrinfo()). This is the default lookup.
+		*
+		* @param hostname Hostname to resolve.
+		* @return Numeric addresses the hostname resolved to.
+		*/
+		static Addresses systemLookup(const std::string &hostname);
+
+		/**
+		* @brief Replaces the function used to resolve hostnames, such as with a stub for testing. This clears the cache.
+		*
+		* @param in_lookup Function to resolve hostnames with, or nullptr to use systemLookup().
+		*/
+		void setLookup(Lookup in_lookup);
+
+		/**
+		* @brief Sets how long successful lookups are cached for.
+		*
+		* @param in_ttl Time to cache successful lookups for.
+		*/
+		void setPositiveTTL(std::chrono::seconds in_ttl);
+
+		/**
+		* @brief Fetches how long successful lookups are cached for.
+		*
+		* @return Time successful lookups are cached for.
+		*/
+		std::chrono::seconds getPositiveTTL() const;
+
+		/**
+		* @brief Sets how long failed lookups are cached for.
+		*
+		* @param in_ttl Time to cache failed lookups for.
+		*/
+		void setNegativeTTL(std::chrono::seconds in_ttl);
+
+		/**
+		* @brief Fetches how long failed lookups are cached for.
+		*
+		* @return Time failed lookups are cached for.
+		*/
+		std::chrono::seconds getNegativeTTL() const;
+
+		/**
+		* @brief Sets the maximum number of threads which perform lookups. Threads are started as lookups are queued.
+		*
+		* @param in_thread_count Maximum number of lookup threads; at least 1 is always used.
+		*/
+		void setThreadCount(size_t in_thread_count);
+
+		/**
+		* @brief Fetches the maximum number of threads which perform lookups.
+		*
+		* @return Maximum number of lookup threads.
+		*/
+		size_t getThreadCount() const;
+
+		/**
+		* @brief Fetches the number of hostnames cached or being looked up.
+		*
+		* @return Number of cache entries.
+		*/
+		size_t getCacheSize() const;
+
+		/**
+		* @brief Fetches the number of lookups performed, not counting requests answered from the cache.
+		*
+		* @return Number of lookups performed.
+		*/
+		size_t getLookupCount() const;
+
+		/**
+		* @brief Removes all cached results; lookups in progress are unaffected.
+		*/
+		void clear();
+
+		/**
+		* @brief Copying a Resolver is forbidden.
+		*/
+		Resolver(const Resolver &) = delete;
+
+	/** Private members */
+	private:
+		Resolver();
+		~Resolver();
+
+		struct Data;
+		static void runLookups(std::shared_ptr<Data> in_data);
+		std::shared_ptr<Data> m_data; // Shared with the lookup threads, which may outlive the resolver at exit
+	};
+}
+
+#endif // _RESOLVER_H_HEADER
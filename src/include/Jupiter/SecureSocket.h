@@ -24,8 +24,11 @@
  * @brief Provides an OpenSSL implementation on the Socket interface.
  */
 
+#include <memory>
 #include "Socket.h"
 
+struct ssl_session_st; // SSL_SESSION
+
 namespace Jupiter
 {
 	/**
@@ -39,6 +42,27 @@ namespace Jupiter
 	{
 	public:
 
+		/** What a non-blocking operation which couldn't complete is waiting on */
+		enum class IOWait {
+			NONE,
+			READ, // Socket to become readable
+			WRITE // Socket to become writable
+		};
+
+		/** State of kernel TLS (kTLS) offload on a connection */
+		enum class KernelTLS {
+			DISABLED, // Not requested; see setKernelTLS()
+			UNSUPPORTED, // Requested, but OpenSSL or the platform lacks kTLS support
+			PENDING, // Requested, but the handshake hasn't completed yet
+			DECLINED, // Requested, but the kernel didn't take over (tls module not loaded, or cipher not supported)
+			SEND, // The kernel encrypts sent data
+			RECV, // The kernel decrypts received data
+			SEND_RECV // The kernel encrypts sent data and decrypts received data
+		};
+
+		/** Handle to a client-side TLS session, which may be offered on a later connection to resume it */
+		using Session = std::shared_ptr<ssl_session_st>;
+
 		/**
 		* @brief Returns the name of the cipher currently in use.
 		* @return Name of cipher currently in use, or "NONE" if none is in use.
@@ -72,8 +96,20 @@ namespace Jupiter
 		*/
 		virtual bool connect(const char *hostname, unsigned short iPort, const char *clientAddress = nullptr, unsigned short clientPort = 0) override;
 
+		/**
+		* @brief Continues a connection started by startConnect(), followed by the TLS handshake, without blocking.
+		* This may also be used to perform the handshake on a connected socket which was elevated to a SecureSocket.
+		* The handshake must complete within the connect timeout (see setConnectTimeout()), measured from startConnect(),
+		* or from the first call for a socket which was already connected; otherwise, this fails with ETIMEDOUT.
+		*
+		* @return 1 once connected and the handshake is complete, 0 while still in progress, less than 0 on failure.
+		*/
+		virtual int continueConnect() override;
+
 		/**
 		* @brief Interface to provide simple binding to ports.
+		* When listening, this also creates the server-side TLS context, using the certificate from setCertificate().
+		* Sessions are cached and session tickets are issued, so that returning clients may skip the full handshake.
 		*
 		* @param hostname String containing hostname to bind to.
 		* @param iPort Port to bind to.
@@ -83,12 +119,86 @@ namespace Jupiter
 		virtual bool bind(const char *hostname, unsigned short iPort, bool andListen = true) override;
 
 		/**
-		* @brief Accepts an incoming connection for the port bound to.
+		* @brief Accepts an incoming connection for the port bound to, and performs the TLS handshake.
 		*
 		* @return A valid SecureSocket on success, nullptr otherwise.
 		*/
 		virtual SecureSocket *accept() override;
 
+		/**
+		* @brief Accepts an incoming connection for the port bound to into an existing SecureSocket.
+		* Blocking sockets complete the TLS handshake before returning. Otherwise, the handshake is started but must be
+		* driven by calling handshake() until it completes; recv() and send() will also drive it implicitly.
+		*
+		* @param out_socket SecureSocket to accept the connection into; this fails for any other type of Socket.
+		* @param in_blocking True if the accepted socket should be blocking, false otherwise.
+		* @return True if a connection was accepted, false otherwise.
+		*/
+		virtual bool accept(Socket &out_socket, bool in_blocking = true) override;
+
+		/**
+		* @brief Continues the TLS handshake on a socket from accept(Socket&, bool).
+		*
+		* @return 1 once the handshake is complete, 0 if it would block (see getIOWait()), less than 0 on failure.
+		*/
+		int handshake();
+
+		/**
+		* @brief Fetches what the last handshake(), recv(), or send() which would have blocked is waiting on.
+		* Note: TLS may need to write while reading, or read while writing.
+		*
+		* @return What the socket is waiting on, or IOWait::NONE if the last operation didn't block.
+		*/
+		IOWait getIOWait() const;
+
+		/**
+		* @brief Fetches the amount of received data which has been decrypted but not yet read.
+		* Such data doesn't make the underlying socket readable, so it should be read before waiting on the socket again.
+		*
+		* @return Number of bytes which recv() can return without reading from the socket
+		*/
+		size_t getPending() const;
+
+		/**
+		* @brief Fetches the TLS session of the current connection, so that it may be resumed by a later connection.
+		* Note: TLS 1.3 servers issue session tickets after the handshake, so this is best called just before closing.
+		*
+		* @return Resumable session on success, nullptr otherwise.
+		*/
+		Session getSession() const;
+
+		/**
+		* @brief Sets a session from getSession() to offer to the server on the next connect() or initSSL().
+		* The server may decline it, in which case a full handshake is performed.
+		*
+		* @param in_session Session to offer, or nullptr to not offer any.
+		*/
+		void setSession(Session in_session);
+
+		/**
+		* @brief Checks if the current connection resumed a session, rather than performing a full handshake.
+		*
+		* @return True if a session was resumed, false otherwise.
+		*/
+		bool isSessionReused() const;
+
+		/**
+		* @brief Requests kernel TLS (kTLS) offload, so that the kernel takes over the record layer once the handshake
+		* completes, and sendFile() can send files without copying them through user space.
+		* This must be set before connect(), initSSL(), or accept(); accepted sockets inherit it from the listener.
+		* Where kTLS isn't available, encryption stays in user space; see getKernelTLS().
+		*
+		* @param in_enabled True to request kTLS, false otherwise.
+		*/
+		void setKernelTLS(bool in_enabled);
+
+		/**
+		* @brief Fetches whether kernel TLS offload is in use on the current connection, or why not.
+		*
+		* @return State of kTLS offload.
+		*/
+		KernelTLS getKernelTLS() const;
+
 		/**
 		* @brief Closes the socket.
 		*/
@@ -100,7 +210,7 @@ namespace Jupiter
 		* The data written by this function will always end with a null character, which is not counted in the returned value.
 		*
 		* @return Number of bytes received on success, less than or equal to 0 otherwise.
-		* Note: Refer to SSL_read() for detailed return values.
+		* Note: When this would block, -1 is returned and getLastError() returns JUPITER_SOCK_EWOULDBLOCK.
 		*/
 		virtual int peek() override;
 
@@ -109,7 +219,7 @@ namespace Jupiter
 		* The data written by this function will always end with a null character, which is not counted in the returned value.
 		*
 		* @return Number of bytes received on success, less than or equal to 0 otherwise.
-		* Note: Refer to SSL_read() for detailed return values.
+		* Note: When this would block, -1 is returned and getLastError() returns JUPITER_SOCK_EWOULDBLOCK.
 		*/
 		virtual int recv() override;
 
@@ -119,10 +229,31 @@ namespace Jupiter
 		* @param data String containing the data to be send.
 		* @param datalen The size of the data to be sent, in chars.
 		* @return Number of bytes sent on success, less than or equal to 0 otherwise.
-		* Note: Refer to SSL_write() for detailed return values.
+		* Note: When this would block, -1 is returned and getLastError() returns JUPITER_SOCK_EWOULDBLOCK. The same data
+		* must then be sent again once the socket is ready, although it may have moved.
 		*/
 		virtual int send(const char *data, size_t datalen) override;
 
+		/**
+		* @brief Sends multiple buffers across the socket.
+		*
+		* @param in_buffers Buffers to send, in order.
+		* @return Total number of bytes sent on success, less than or equal to 0 otherwise.
+		* Note: When this would block, -1 is returned and getLastError() returns JUPITER_SOCK_EWOULDBLOCK.
+		*/
+		virtual int sendv(std::span<const std::string_view> in_buffers) override;
+
+		/**
+		* @brief Sends part of a file across the socket. With kernel TLS offload, this uses sendfile(); otherwise, the
+		* file is read in chunks and encrypted, since the data must pass through user space anyway.
+		*
+		* @param in_fd Descriptor of the file to send from.
+		* @param in_offset Offset within the file to start sending from.
+		* @param in_count Number of bytes to send.
+		* @return Number of bytes sent on success, less than or equal to 0 otherwise.
+		*/
+		virtual int sendFile(int in_fd, uint64_t in_offset, size_t in_count) override;
+
 		/**
 		* @brief Initializes SSL on the socket.
 		* Note: This is only relevant when elevating an existing Socket to a SecureSocket.
@@ -179,6 +310,8 @@ namespace Jupiter
 
 	/** Private members */
 	private:
+		bool initClientHandle();
+
 		struct SSLData;
 		SSLData *m_ssl_data;
 	};
@@ -24,12 +24,17 @@
  * @brief Provides cross-platform socket interaction.
  */
 
+#include <chrono>
 #include <cstring>
+#include <functional>
+#include <optional>
+#include <span>
 #include <string>
 #include <string_view>
 #include "Jupiter.h"
 
 struct addrinfo;
+struct sockaddr;
 
 #ifdef _WIN32
 #define JUPITER_SOCK_EWOULDBLOCK 10035
@@ -53,6 +58,33 @@ namespace Jupiter
 	class JUPITER_API Socket
 	{
 	public:
+		/**
+		* @brief Tuning options applied to a socket when it is created, before it binds or connects.
+		* Unset options are left at the system's defaults. TCP options only apply to stream sockets, and options which
+		* the platform doesn't support are ignored.
+		*/
+		struct Options {
+			std::optional<bool> no_delay; // TCP_NODELAY: send small writes immediately, rather than coalescing them
+			std::optional<int> receive_buffer_size; // SO_RCVBUF, in bytes
+			std::optional<int> send_buffer_size; // SO_SNDBUF, in bytes
+			std::optional<bool> keep_alive; // SO_KEEPALIVE
+			std::optional<std::chrono::seconds> keep_alive_idle; // TCP_KEEPIDLE: idle time before the first probe
+			std::optional<std::chrono::seconds> keep_alive_interval; // TCP_KEEPINTVL: time between unanswered probes
+			std::optional<int> keep_alive_count; // TCP_KEEPCNT: unanswered probes before the connection is dropped
+			std::optional<bool> fast_open; // TCP_FASTOPEN on listeners, TCP_FASTOPEN_CONNECT on connecting sockets
+			std::optional<int> fast_open_queue_length; // Pending fast open requests allowed on listeners; 256 if unset
+			std::optional<std::chrono::microseconds> busy_poll; // SO_BUSY_POLL: time to busy-wait for data before sleeping
+
+			/**
+			* @brief Reads options from the config keys "TCPNoDelay", "ReceiveBufferSize", "SendBufferSize", "KeepAlive",
+			* "KeepAliveIdle" & "KeepAliveInterval" (in seconds), "KeepAliveCount", "TCPFastOpen", "TCPFastOpenQueueLength",
+			* and "BusyPoll" (in microseconds). Options whose keys aren't set are left unset.
+			*
+			* @param in_lookup Function which fetches the value of a config key, or an empty string if it isn't set.
+			* @return Options read.
+			*/
+			static Options read(const std::function<std::string_view(std::string_view key)> &in_lookup);
+		};
 
 		/**
 		* @brief Sets the socket type. Primarily intended for use by class extensions.
@@ -70,6 +102,7 @@ namespace Jupiter
 
 		/**
 		* @brief Resolves and stores address information in an addrinfo struct.
+		* Hostnames are resolved through Resolver::instance(), and so may be answered from its cache.
 		* The addrinfo returned by this function should be freed by freeAddrInfo().
 		*
 		* @param host String containing the hostname of the target.
@@ -211,6 +244,59 @@ namespace Jupiter
 		*/
 		virtual bool connect(const char *hostname, unsigned short iPort, const char *clientHostname = nullptr, unsigned short clientPort = 0);
 
+		/**
+		* @brief Starts connecting to a server without blocking; continueConnect() must then be called until it completes.
+		* The hostname is resolved by the Resolver in the background, and connections are attempted per Happy Eyeballs (RFC 8305):
+		* addresses alternate between families (i.e: IPv6 and IPv4), and each attempt is started 250ms after the
+		* previous one, or immediately once it fails. The first attempt to connect is kept, and the rest are closed.
+		*
+		* @param hostname String containing hostname of server to connect to.
+		* @param iPort Port to connect on.
+		* @param clientHostname Optional parameter to specify the address for socket to bind to.
+		* @param clientPort Optional parameter to specify the port for socket to bind to.
+		* @return True if the connection was started, false otherwise.
+		*/
+		virtual bool startConnect(const char *hostname, unsigned short iPort, const char *clientHostname = nullptr, unsigned short clientPort = 0);
+
+		/**
+		* @brief Continues a connection started by startConnect(), without blocking.
+		* Completion is detected by polling each attempt for writability. A connected socket is left in non-blocking mode.
+		*
+		* @return 1 once connected, 0 while still connecting, or a negative value if every attempt failed or the connect timeout elapsed.
+		*/
+		virtual int continueConnect();
+
+		/**
+		* @brief Sets how long connect() and startConnect() may take, including hostname resolution.
+		* Note: This applies to connections started after it is set.
+		*
+		* @param in_timeout Maximum time to spend connecting.
+		*/
+		void setConnectTimeout(std::chrono::milliseconds in_timeout);
+
+		/**
+		* @brief Fetches how long connect() and startConnect() may take.
+		*
+		* @return Maximum time to spend connecting.
+		*/
+		std::chrono::milliseconds getConnectTimeout() const;
+
+		/**
+		* @brief Sets how long startConnect() waits on an attempt before also trying the next address (RFC 8305's
+		* "Connection Attempt Delay"). Defaults to 250 milliseconds.
+		* Note: This applies to connections started after it is set.
+		*
+		* @param in_delay Delay between starting each connection attempt.
+		*/
+		void setConnectionAttemptDelay(std::chrono::milliseconds in_delay);
+
+		/**
+		* @brief Fetches how long startConnect() waits on an attempt before also trying the next address.
+		*
+		* @return Delay between starting each connection attempt.
+		*/
+		std::chrono::milliseconds getConnectionAttemptDelay() const;
+
 		/**
 		* @brief Interface to provide simple binding to ports.
 		*
@@ -221,6 +307,36 @@ namespace Jupiter
 		*/
 		virtual bool bind(const char *hostname, unsigned short iPort, bool andListen = true);
 
+		/**
+		* @brief Sets whether or not other sockets may bind to the same address and port (SO_REUSEPORT).
+		* When multiple listening sockets share a port, incoming connections are distributed between them.
+		* Note: This must be set before calling bind(). This has no effect on platforms without SO_REUSEPORT.
+		*
+		* @param in_reuse_port True if the port should be shared, false otherwise.
+		*/
+		void setReusePort(bool in_reuse_port);
+
+		/**
+		* @brief Sets tuning options, which are applied to sockets created by later calls to bind(), connect(), and
+		* startConnect(), as well as to the current socket (if any).
+		* Note: Buffer sizes and fast open only take full effect when set before binding or connecting. Sockets accepted
+		* from a listener inherit its options from the system.
+		* Note: With fast open, a connection may only be refused or time out upon the first send; the connect timeout
+		* can't detect either. So that Happy Eyeballs still works, startConnect() ignores fast open for hostnames which
+		* resolve to more than one address.
+		*
+		* @param in_options Options to apply.
+		* @return True if every option was applied to the current socket (or there is none), false otherwise.
+		*/
+		bool setOptions(const Options &in_options);
+
+		/**
+		* @brief Fetches the tuning options applied to new sockets.
+		*
+		* @return Tuning options.
+		*/
+		const Options &getOptions() const;
+
 		/**
 		* @brief Accepts an incoming connection for the port bound to.
 		*
@@ -228,6 +344,17 @@ namespace Jupiter
 		*/
 		virtual Socket *accept();
 
+		/**
+		* @brief Accepts an incoming connection for the port bound to into an existing socket, reusing its buffer.
+		* Any connection out_socket already has is closed first. On a non-blocking listener, call this until it returns
+		* false to drain every pending connection.
+		*
+		* @param out_socket Socket to accept the connection into.
+		* @param in_blocking True if the accepted socket should be blocking, false otherwise.
+		* @return True if a connection was accepted, false otherwise.
+		*/
+		virtual bool accept(Socket &out_socket, bool in_blocking = true);
+
 		/**
 		* @brief Sets the timeout for recv() in milliseconds.
 		* Note: This only affects blocking sockets.
@@ -363,6 +490,30 @@ namespace Jupiter
 		*/
 		void clearBuffer();
 
+		/**
+		* @brief Sets whether recv() appends to the data left in the buffer, rather than replacing it.
+		* This allows messages to be parsed in place over getBuffer(), with consumeBuffer() called for whatever was
+		* processed; incomplete messages are left in the buffer until the rest arrives. The buffer grows as needed.
+		* Note: peek() and recvFrom() always replace the buffer's contents.
+		*
+		* @param in_retain True if recv() should keep unconsumed data, false otherwise.
+		*/
+		void setRetainBuffer(bool in_retain);
+
+		/**
+		* @brief Checks whether recv() appends to the data left in the buffer.
+		*
+		* @return True if recv() keeps unconsumed data, false otherwise.
+		*/
+		bool getRetainBuffer() const;
+
+		/**
+		* @brief Discards data from the front of the buffer, once it's been processed.
+		*
+		* @param in_count Number of bytes to discard.
+		*/
+		void consumeBuffer(size_t in_count);
+
 		/**
 		* @brief Writes new data from the socket to the buffer, without removing it from the socket queue.
 		* The data written by this function will always end with a null character, which is not counted in the returned value.
@@ -386,6 +537,7 @@ namespace Jupiter
 		/**
 		* @brief Writes new data from the socket to the buffer.
 		* The data written by this function will always end with a null character, which is not counted in the returned value.
+		* If the buffer is retained (see setRetainBuffer()), the data is appended to what's left in the buffer.
 		*
 		* @return Number of bytes written to buffer on success, SOCKET_ERROR (-1) otherwise.
 		* Note: Any returned value less than or equal to 0 should be treated as an error.
@@ -435,6 +587,28 @@ namespace Jupiter
 		*/
 		int send(const char *msg);
 
+		/**
+		* @brief Sends multiple buffers across the socket in a single call (i.e: writev), without concatenating them.
+		* Note: As with send(), fewer bytes than the total may be sent.
+		*
+		* @param in_buffers Buffers to send, in order.
+		* @return Total number of bytes sent on success, SOCKET_ERROR (-1) otherwise.
+		* Note: Any returned value less than or equal to 0 should be treated as an error.
+		*/
+		virtual int sendv(std::span<const std::string_view> in_buffers);
+
+		/**
+		* @brief Sends part of a file across the socket, without copying it through user space where possible (i.e: sendfile).
+		* Note: As with send(), fewer bytes than requested may be sent.
+		*
+		* @param in_fd Descriptor of the file to send from.
+		* @param in_offset Offset within the file to start sending from.
+		* @param in_count Number of bytes to send.
+		* @return Number of bytes sent on success, SOCKET_ERROR (-1) otherwise.
+		* Note: Any returned value less than or equal to 0 should be treated as an error.
+		*/
+		virtual int sendFile(int in_fd, uint64_t in_offset, size_t in_count);
+
 		/**
 		* @brief Sends data across the socket.
 		*
@@ -519,7 +693,9 @@ namespace Jupiter
 		virtual ~Socket();
 
 		/**
-		* @brief An extremely basic data buffer
+		* @brief An extremely basic data buffer.
+		* Data may be consumed from the front and appended to the back; consumed space is reclaimed by sliding the
+		* remaining data to the front when more room is needed, so that the data always remains contiguous.
 		*/
 		class Buffer {
 		public:
@@ -530,6 +706,10 @@ namespace Jupiter
 			[[nodiscard]] size_t size() const;
 			void reserve(size_t new_capacity);
 			void clear();
+			void consume(size_t in_count); // Discards data from the front
+			[[nodiscard]] char* prepare(size_t in_min_free); // Makes room for at least in_min_free bytes; returns the end of the data
+			[[nodiscard]] size_t free_space() const; // Bytes which may be written after the end of the data
+			void commit(size_t in_count); // Appends in_count bytes written after the end of the data
 			[[nodiscard]] std::string_view view() const;
 			[[nodiscard]] void* data() const;
 			[[nodiscard]] char* chr_data() const;
@@ -537,18 +717,27 @@ namespace Jupiter
 		private:
 			void* m_buffer;
 			size_t m_buffer_capacity;
+			size_t m_buffer_offset; // Start of the data; bytes before this have been consumed
 			size_t m_buffer_size;
 		};
 
-	/** Protected functions and members*/
-	protected:
-
 #if defined _WIN32
 		typedef uintptr_t SocketType;
 #else
 		typedef int SocketType;
 #endif
 
+		/**
+		* @brief Fetches the raw socket descriptor.
+		* This is primarily intended for class extensions and for registering the socket with readiness APIs (i.e: epoll).
+		*
+		* @return A raw socket descriptor.
+		*/
+		SocketType getDescriptor() const;
+
+	/** Protected functions and members*/
+	protected:
+
 		/**
 		* @brief Fetches the buffer where data is stored
 		*
@@ -557,11 +746,23 @@ namespace Jupiter
 		Buffer &getInternalBuffer() const;
 
 		/**
-		* @brief Used by class extensions to get the socket descriptor.
+		* @brief Prepares the buffer for recv() to write into. The buffer's contents are discarded first, unless they're
+		* being retained (see setRetainBuffer()). Received data is then added by calling commit() on the buffer.
 		*
-		* @return A raw socket descriptor.
+		* @return Space to receive data into.
 		*/
-		SocketType getDescriptor() const;
+		std::span<char> prepareReceive();
+
+		/**
+		* @brief Sends part of a file by reading it into a buffer, and passing that to send().
+		* This is used by sendFile() where the data must pass through user space anyway (i.e: TLS).
+		*
+		* @param in_fd Descriptor of the file to send from.
+		* @param in_offset Offset within the file to start sending from.
+		* @param in_count Number of bytes to send.
+		* @return Number of bytes sent on success, SOCKET_ERROR (-1) otherwise.
+		*/
+		int sendFileBuffered(int in_fd, uint64_t in_offset, size_t in_count);
 
 		/**
 		* @brief Used by class extensions to set the appropriate socket descriptor.
@@ -570,8 +771,18 @@ namespace Jupiter
 		*/
 		void setDescriptor(SocketType descript);
 
+		/**
+		* @brief Fetches the time by which the connection started by startConnect() must complete.
+		* This allows class extensions to hold handshakes performed by continueConnect() to the same deadline.
+		*
+		* @return Deadline of the connection in progress, or time_point::max() if none is in progress.
+		*/
+		std::chrono::steady_clock::time_point getConnectDeadline() const;
+
 	/** Private members */
 	private:
+		void setAccepted(const Socket &listener, SocketType descriptor, bool blocking, const sockaddr *address, size_t address_size);
+
 		struct Data;
 		Data *m_data;
 	};
@@ -44,6 +44,14 @@ namespace Jupiter
 		*/
 		virtual int think() = 0;
 
+		/**
+		* @brief Fetches a descriptor which becomes readable when think() has work to do, so that an EventLoop
+		* can sleep until then rather than calling think() on a short interval.
+		*
+		* @return Descriptor to wait on, or -1 if think() should only be called on an interval.
+		*/
+		virtual int getDescriptor() const { return -1; }
+
 		/**
 		* @brief Virtual destructor for the "Thinker" interface. Does nothing.
 		*/
@@ -81,6 +81,13 @@ namespace Jupiter
 		*/
 		static size_t check();
 
+		/**
+		* @brief Fetches the time at which the next timer is due, so that a caller may sleep until then.
+		*
+		* @return Earliest time at which a timer is due, or time_point::max() if there are no timers.
+		*/
+		static std::chrono::steady_clock::time_point next();
+
 		/**
 		* @brief Immediately destroys all timers.
 		*
@@ -36,6 +36,49 @@ namespace Jupiter
 	class JUPITER_API UDPSocket : public Socket
 	{
 	public:
+
+		/**
+		* @brief A datagram within a batch passed to recvBatch() or sendBatch().
+		* Payload buffers and addresses are provided by the caller, so that batches may reuse the same storage.
+		*/
+		struct Datagram {
+			char *data = nullptr; // Payload buffer
+			size_t capacity = 0; // Size of the payload buffer; recvBatch() truncates datagrams larger than this
+			size_t size = 0; // Payload length; set by recvBatch(), and read by sendBatch()
+			sockaddr *address = nullptr; // Sender for recvBatch(), or destination for sendBatch(); typically a sockaddr_storage. May be nullptr.
+			size_t address_size = 0; // Size of *address; recvBatch() sets this to the size of the sender's address
+			size_t segment_size = 0; // If non-zero, the payload is a series of datagrams of this size (the last may be shorter); see setReceiveOffload()
+			bool truncated = false; // Set by recvBatch() if the datagram didn't fit within capacity
+		};
+
+		/**
+		* @brief Receives as many datagrams as are available, up to the size of the batch, in as few calls as possible
+		* (recvmmsg on Linux). Only the first datagram is waited on, if the socket is blocking.
+		*
+		* @param io_datagrams Datagrams to receive into; data, capacity, address, and address_size must be set.
+		* @return Number of datagrams received on success, SOCKET_ERROR (-1) otherwise.
+		*/
+		int recvBatch(std::span<Datagram> io_datagrams);
+
+		/**
+		* @brief Sends a batch of datagrams, in as few calls as possible (sendmmsg on Linux).
+		* A datagram with a segment_size is split into datagrams of that size; on Linux, the kernel does so (UDP GSO).
+		*
+		* @param in_datagrams Datagrams to send; data, size, address, and address_size must be set.
+		* @return Number of entries from in_datagrams sent on success, SOCKET_ERROR (-1) otherwise.
+		*/
+		int sendBatch(std::span<const Datagram> in_datagrams);
+
+		/**
+		* @brief Sets whether the kernel may coalesce consecutive datagrams from the same sender into one buffer (UDP GRO).
+		* recvBatch() reports coalesced datagrams through Datagram::segment_size.
+		* Note: This is only supported on Linux.
+		*
+		* @param in_enabled True to enable receive offload, false otherwise.
+		* @return True on success, false otherwise.
+		*/
+		bool setReceiveOffload(bool in_enabled);
+
 		UDPSocket &operator=(UDPSocket &&source);
 		UDPSocket();
 		UDPSocket(const UDPSocket &) = delete;